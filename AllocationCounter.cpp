@@ -0,0 +1,30 @@
+#include "AllocationCounter.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t allocations = 0;
+
+uint64_t AllocationCounter::threadAllocations()
+{
+    return allocations;
+}
+
+// Replacement global allocator, array and nothrow forms forward to it
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+/*
+Counts heap allocations made through global operator new, per thread and without locks.
+The replacement allocator is always linked in, so the search path can report its allocations in every build,
+counting costs one thread-local increment per allocation.
+
+Usage: read threadAllocations() before and after a region, the difference is what that thread allocated in it.
+*/
+
+class AllocationCounter {
+public:
+    // Allocations made by the calling thread since it started
+    static uint64_t threadAllocations();
+};
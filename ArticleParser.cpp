@@ -1,11 +1,22 @@
 #include "ArticleParser.h"
+#include "CorpusFile.h"
+#include "MappedFile.h"
+#include "MemoryStats.h"
 #include "PageItem.h"
+#include "TextArena.h"
+#include "ThreadPool.h"
+#include "Trace.h"
 #include "VectorStorage.h"
 
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
-#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <nlohmann/json.hpp>
 #include <nlohmann/json_fwd.hpp>
@@ -13,66 +24,275 @@
 namespace fs = std::filesystem;     // for directory iteration
 using json = nlohmann::json;        // for JSON parsing
 
+constexpr size_t PARSE_CHUNK_LINES = 256;   // JSON lines parsed in parallel into one arena before they are batched
+
 // Constructor
 ArticleParser::ArticleParser(
     const std::string& jsonPath,
-    size_t batchSize,
+    size_t tokenBudget,
     VectorStorage& storage,
-    int maxPages)
-	: jsonPath(jsonPath), batchSize(batchSize), storage(storage), maxPages(maxPages) {  
+    int maxPages,
+    size_t memoryLimitBytes)
+	: jsonPath(jsonPath), batchSizer(tokenBudget, memoryLimitBytes), storage(storage), maxPages(maxPages) {
 }
 
-// Parse JSON files in the specified directory
+// Parse JSON and corpus files in the specified directory
 void ArticleParser::parseJSONFiles() {
-    std::vector<PageItem> batch;
-	int pageCount = 0;
+    batch = ArticleBatch{};
+	pageCount = 0;
+    sourceBytes = 0;
+    copiedBytes = 0;
+    stopRequested = false;
 
-	// Iterate over all JSON files in the directory
+	// Corpus files are converted from the JSON files, so when any exist the JSON files are skipped
+    std::vector<std::string> jsonFiles, corpusFiles;
     for (const auto& entry : fs::directory_iterator(jsonPath)) {
-        if (entry.path().extension() != ".json") continue;
-
-        std::ifstream file(entry.path());
-        if (!file) continue;
-
-		// Read each line (article) in the JSON file
-        std::string line;
-        while (std::getline(file, line)) {
-			++pageCount;
-            auto j = json::parse(line, nullptr, false);
-            if (j.is_discarded()) continue;
-
-			std::cout << "Processing article: " << j.value("title", "") << std::endl;
-
-            std::string text = j.value("text", "");
-            if (text.find("#REDIRECT") != std::string::npos) continue;
-
-			// Add article to batch
-            batch.push_back({
-                j.value("title", ""),
-                text,
-                "https://en.wikipedia.org/wiki/" + j.value("title", "")
-            });
-
-            if (batch.size() >= batchSize) {
-				std::cout << "Flushing batch of size: " << batch.size() << std::endl;
-                flushBatch(batch);
-				batch.clear();
-            }
-
-			// Check if max pages limit is reached
-            if (maxPages != -1 && pageCount >= maxPages) {
-                std::cout << "MAX PAGES REACHED: " << maxPages << std::endl;
-                flushBatch(batch);
-                return;
-            }
-        } 
-		file.close();
+        if (entry.path().extension() == CORPUS_EXTENSION) corpusFiles.push_back(entry.path().string());
+        else if (entry.path().extension() == ".json") jsonFiles.push_back(entry.path().string());
+    }
+
+    if (!corpusFiles.empty()) {
+        for (const auto& path : corpusFiles) {
+            if (!parseCorpusFile(path)) break;
+        }
+    }
+    else {
+        for (const auto& path : jsonFiles) {
+            if (!parseJSONFile(path)) break;
+        }
+    }
+
+    if (stopRequested) {
+        std::cout << "Ingestion stopped after " << pageCount << " articles" << std::endl;
+        batch = ArticleBatch{};
+        return;
+    }
+
+    flushBatch();
+    batchSizer.printSummary();
+    printCopySummary();
+    std::cout << "Ingestion finished, " << pageCount << " articles read" << std::endl;
+}
+
+// SAX handler keeping only the top level title, text and metadata of an article line, nothing else is materialized
+class ArticleSax : public nlohmann::json_sax<json> {
+public:
+    std::string title;
+    std::string text;
+    std::string timestamp;
+    std::string categories;     // newline separated
+    int32_t ns = 0;
+    int32_t length = 0;
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t value) override { return number(value); }
+    bool number_unsigned(number_unsigned_t value) override { return number(static_cast<int64_t>(value)); }
+    bool number_float(number_float_t, const string_t&) override { return true; }
+    bool binary(binary_t&) override { return true; }
+    bool start_object(std::size_t) override { ++depth; return true; }
+    bool end_object() override { --depth; return true; }
+
+    bool start_array(std::size_t) override
+    {
+        inCategories = depth == 1 && field == Field::Categories;
+        ++depth;
+        return true;
+    }
+
+    bool end_array() override
+    {
+        --depth;
+        inCategories = false;
+        return true;
+    }
+
+    bool key(string_t& name) override
+    {
+        if (depth != 1) return true;
+        field = name == "title" ? Field::Title
+            : name == "text" ? Field::Text
+            : name == "timestamp" ? Field::Timestamp
+            : name == "categories" ? Field::Categories
+            : name == "ns" ? Field::Ns
+            : name == "length" ? Field::Length
+            : Field::None;
+        return true;
+    }
+
+    // The lexer clears its token buffer before the next token, so values are moved out rather than copied
+    bool string(string_t& value) override
+    {
+        if (inCategories && depth == 2) {
+            if (!categories.empty()) categories.push_back('\n');
+            categories.append(value);
+        }
+        else if (depth == 1) {
+            if (field == Field::Title) title = std::move(value);
+            else if (field == Field::Text) text = std::move(value);
+            else if (field == Field::Timestamp) timestamp = std::move(value);
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override
+    {
+        return false;
+    }
+
+private:
+    enum class Field { None, Title, Text, Timestamp, Categories, Ns, Length };
+
+    bool number(int64_t value)
+    {
+        if (depth == 1 && field == Field::Ns) ns = static_cast<int32_t>(value);
+        else if (depth == 1 && field == Field::Length) length = static_cast<int32_t>(value);
+        return true;
+    }
+
+    int depth = 0;
+    Field field = Field::None;
+    bool inCategories = false;
+};
+
+// Parse one article line, strings are copied into the chunk arena, nullopt for malformed lines and redirects
+static std::optional<PageItem> parseArticle(std::string_view line, TextArena& arena)
+{
+    ArticleSax sax;
+    if (!json::sax_parse(line, &sax)) return std::nullopt;
+    if (sax.text.find("#REDIRECT") != std::string::npos) return std::nullopt;
+
+    ArticleMeta meta{ sax.ns, sax.length, arena.store(sax.timestamp), arena.store(sax.categories) };
+    return PageItem{ arena.store(sax.title), arena.store(sax.text), {}, meta };
+}
+
+// String bytes of a page, what the JSON path copies into its arena
+static size_t pageBytes(const PageItem& page)
+{
+    return page.title.size() + page.text.size() + page.meta.timestamp.size() + page.meta.categories.size();
+}
+
+// Parse one JSON file, one article per line, lines are sliced out of a mapping and parsed in chunks on the shared thread pool
+bool ArticleParser::parseJSONFile(const std::string& path) {
+    MappedFile file;
+    try {
+        file = MappedFile(path, MapAdvice::Sequential);
+    }
+    catch (const std::exception&) {
+        return true;
+    }
+
+    std::string_view rest = file.view();
+    std::vector<std::string_view> lines;
+    std::vector<std::optional<PageItem>> pages;
+    lines.reserve(PARSE_CHUNK_LINES);
+
+    while (!rest.empty()) {
+		// Slice a chunk of lines (articles) out of the mapping
+        lines.clear();
+        size_t chunkBytes = 0;
+        while (lines.size() < PARSE_CHUNK_LINES && !rest.empty()) {
+            size_t eol = rest.find('\n');
+            std::string_view line = rest.substr(0, eol);
+            rest = eol == std::string_view::npos ? std::string_view{} : rest.substr(eol + 1);
+
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            chunkBytes += line.size();
+            lines.push_back(line);
+        }
+
+		// Unescaped strings are never longer than the JSON they came from, so one arena block holds the chunk
+        auto arena = std::make_shared<TextArena>(chunkBytes);
+        pages.assign(lines.size(), std::nullopt);
+        ThreadPool::shared().parallelFor(0, lines.size(), 16, [&](size_t i) {
+            TRACE_SCOPE("ArticleParser::parseArticle");
+            pages[i] = parseArticle(lines[i], *arena);
+        });
+        copiedBytes += arena->bytesStored();
+
+		// Batch in file order, batches keep the arena alive until they are ingested
+        std::shared_ptr<const void> owner = arena;
+        for (auto& page : pages) {
+            if (stopRequested || !consumePage()) return false;
+            if (!page) continue;
+            sourceBytes += pageBytes(*page);
+            addPage(*page, owner);
+        }
+    }
+    return true;
+}
+
+// Read one binary corpus file, redirects were already dropped and token stats precomputed by the converter
+bool ArticleParser::parseCorpusFile(const std::string& path) {
+    auto reader = std::make_shared<const CorpusReader>(path);
+
+    for (size_t b = 0; b < reader->blockCount(); ++b) {
+        auto block = std::make_shared<const CorpusBlock>(reader->readBlock(b));
+        for (const auto& buffer : block->buffers) copiedBytes += buffer.size();
+
+		// Uncompressed articles are views into the mapping, decompressed ones into the block
+        std::shared_ptr<const void> owner = reader->compressed()
+            ? std::shared_ptr<const void>(block)
+            : std::shared_ptr<const void>(reader);
+
+        for (const auto& article : block->articles) {
+            if (stopRequested || !consumePage()) return false;
+            PageItem page{ article.title, article.text, article.tokenStats, article.meta };
+            sourceBytes += pageBytes(page);
+            addPage(page, owner);
+        }
     }
+    return true;
 }
 
-// Flush the current batch to storage
-void ArticleParser::flushBatch(std::vector<PageItem>& batch) {
-    if (batch.empty()) return;
-    
-	storage.ingestBatch(batch);
+// Checked for every line consumed, so redirects and malformed lines can't run past the limit
+bool ArticleParser::consumePage() {
+    if (maxPages != -1 && pageCount >= maxPages) {
+        std::cout << "MAX PAGES REACHED: " << maxPages << std::endl;
+        flushBatch();
+        return false;
+    }
+    ++pageCount;
+    return true;
+}
+
+// Add page to the current batch, flushing it once the token budget is reached
+void ArticleParser::addPage(const PageItem& page, const std::shared_ptr<const void>& owner) {
+    batch.tokens += BatchSizer::estimateTokens(page.text);
+    batch.pages.push_back(page);
+    batch.retain(owner);
+
+    if (batch.tokens >= batchSizer.tokenBudget()) {
+        flushBatch();
+    }
+}
+
+// Stop a running parse after the current batch
+void ArticleParser::requestStop() {
+    stopRequested = true;
+}
+
+// Move the current batch to storage, timing it to tune the next batch size
+void ArticleParser::flushBatch() {
+    if (batch.pages.empty()) return;
+    TRACE_SCOPE("ArticleParser::flushBatch");
+
+    size_t articles = batch.pages.size();
+    size_t tokens = batch.tokens;
+
+    auto start = std::chrono::steady_clock::now();
+	storage.ingestBatch(std::move(batch));     // the batch and its arenas are released once ingested
+    batchSizer.record(articles, tokens, std::chrono::steady_clock::now() - start);
+    batch = ArticleBatch{};
+}
+
+// Article bytes read and copied per article, copies by the JSON lexer and the COPY stream are not counted
+void ArticleParser::printCopySummary() const {
+    if (pageCount == 0) return;
+
+    std::cout << std::fixed << std::setprecision(2)
+        << "Article bytes per article: " << sourceBytes / pageCount << " read, "
+        << copiedBytes / pageCount << " copied (" << (sourceBytes ? static_cast<double>(copiedBytes) / sourceBytes : 0.0)
+        << " copies per byte), peak RSS " << peakResidentMemoryBytes() / (1024 * 1024) << " MB"
+        << std::defaultfloat << std::endl;
 }
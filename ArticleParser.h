@@ -1,7 +1,10 @@
 #pragma once
+#include "BatchSizer.h"
 #include "PageItem.h"
 #include "VectorStorage.h"
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 #include <future>
@@ -10,26 +13,43 @@
 /*
 This class is responsible for parsing JSON files containing articles
 Relies on WikipediaSearch.py to generate JSON files from Wikipedia dumps
+Binary corpus files (.edbc, see CorpusFile) in the same directory are read from a memory mapping without any parsing
+Pages are views, JSON articles are copied once into a TextArena per chunk and corpus articles point into the mapping
 */
 
 // Parses JSON files containing articles and stores in vector storage
 class ArticleParser {
 private:
 	std::list<std::future<void>> activeTasks;
-	void flushBatch(std::vector<PageItem>& batch);	// Flush a batch of PageItems to vector storage
+	void flushBatch();	// Move the current batch into vector storage
+	bool parseJSONFile(const std::string& path);	// Returns false once parsing should end
+	bool parseCorpusFile(const std::string& path);	// Returns false once parsing should end
+	bool consumePage();	// Count a line or corpus article, redirects and malformed lines included, flushes and returns false past max pages
+	void addPage(const PageItem& page, const std::shared_ptr<const void>& owner);	// Add page to the current batch
 
 	std::string jsonPath;       // relative path to JSON files
-	size_t batchSize;           // batch size for processing, will input into DB after n articles
+	BatchSizer batchSizer;      // token budget per batch, tuned from measured throughput and memory
 	VectorStorage& storage;     // reference to vector storage
 	int maxPages;               // maximum number of pages to parse (-1 for no limit)
+	std::atomic<bool> stopRequested{ false };   // set to stop a running parse after the current batch
+
+	ArticleBatch batch;	// current batch, only used by the parsing thread
+	int pageCount = 0;
+
+	// Copy accounting, reported when ingestion ends
+	size_t sourceBytes = 0;     // article bytes read from JSON lines or corpus columns
+	size_t copiedBytes = 0;     // title and text bytes copied into arenas
+	void printCopySummary() const;
 
 public:
     ArticleParser(
 		const std::string& jsonPath,
-        size_t batchSize,
+        size_t tokenBudget,
         VectorStorage& storage,
-		int maxPages
+		int maxPages,
+		size_t memoryLimitBytes = 0
     );
 
-	void parseJSONFiles();      // Parse JSON files
+	void parseJSONFiles();      // Parse JSON and corpus files, safe to run on a background thread
+	void requestStop();         // Stop a running parse after the current batch
 };
@@ -0,0 +1,87 @@
+#include "BatchSizer.h"
+#include "MemoryStats.h"
+#include "WordPieceTokenizer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <string_view>
+
+constexpr size_t ARTICLE_OVERHEAD_TOKENS = 32;  // fixed per-article cost (special tokens, row overhead)
+constexpr double GROW_FACTOR = 1.25;
+constexpr double SHRINK_FACTOR = 0.8;
+constexpr double NOISE_TOLERANCE = 0.98;        // throughput must drop below this ratio to reverse direction
+
+// Constructor
+BatchSizer::BatchSizer(size_t initialBudget, size_t memoryLimitBytes, size_t minBudget, size_t maxBudget)
+    : budget(std::clamp(initialBudget, minBudget, maxBudget)),
+    memoryLimit(memoryLimitBytes),
+    minBudget(minBudget),
+    maxBudget(maxBudget),
+    minChosenBudget(budget),
+    maxChosenBudget(budget) {
+}
+
+size_t BatchSizer::tokenBudget() const
+{
+    return budget;
+}
+
+// Texts are truncated to EMBED_MAX_TOKENS, so embedding a long article costs no more than a short one
+size_t BatchSizer::estimateTokens(std::string_view text)
+{
+    size_t words = 0;
+    bool inWord = false;
+    for (unsigned char c : text) {
+        bool space = std::isspace(c);
+        words += (!space && !inWord);
+        inWord = !space;
+        if (words >= EMBED_MAX_TOKENS) break;
+    }
+    return words + ARTICLE_OVERHEAD_TOKENS;
+}
+
+// Hill climb on throughput, back off hard on memory pressure
+void BatchSizer::record(size_t articles, size_t tokens, std::chrono::duration<double> elapsed)
+{
+    batches++;
+    totalArticles += articles;
+    minArticles = batches == 1 ? articles : std::min(minArticles, articles);
+    maxArticles = std::max(maxArticles, articles);
+
+    double throughput = elapsed.count() > 0.0 ? tokens / elapsed.count() : 0.0;
+    size_t rss = anonymousMemoryBytes();
+    size_t previous = budget;
+
+    if (memoryLimit != 0 && rss > memoryLimit) {
+        budget = std::max(minBudget, budget / 2);
+        direction = -1;
+        lastThroughput = 0.0;   // memory, not throughput, picked this size
+    }
+    else {
+        if (lastThroughput > 0.0 && throughput < lastThroughput * NOISE_TOLERANCE) {
+            direction = -direction;
+        }
+        double factor = direction > 0 ? GROW_FACTOR : SHRINK_FACTOR;
+        budget = std::clamp(static_cast<size_t>(budget * factor), minBudget, maxBudget);
+        lastThroughput = throughput;
+    }
+
+    minChosenBudget = std::min(minChosenBudget, budget);
+    maxChosenBudget = std::max(maxChosenBudget, budget);
+
+    std::cout << "Batch " << batches << ": " << articles << " articles, " << tokens << " tokens, "
+        << static_cast<size_t>(throughput) << " tokens/s, anon RSS " << rss / (1024 * 1024) << " MB, budget "
+        << previous << " -> " << budget << std::endl;
+}
+
+void BatchSizer::printSummary() const
+{
+    if (batches == 0) return;
+
+    std::cout << "Batches: " << batches
+        << ", articles per batch min/avg/max: " << minArticles << "/" << totalArticles / batches << "/" << maxArticles
+        << ", token budget min/final/max: " << minChosenBudget << "/" << budget << "/" << maxChosenBudget
+        << std::endl;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+
+/*
+This class sizes ingest batches by an estimated token budget instead of an article count.
+The budget is tuned online by hill climbing on measured embed + insert throughput,
+and halved whenever resident anonymous memory goes over the configured limit.
+*/
+
+class BatchSizer {
+public:
+    BatchSizer(
+        size_t initialBudget,           // tokens per batch to start with
+        size_t memoryLimitBytes = 0,    // 0 for no memory limit
+        size_t minBudget = 10'000,
+        size_t maxBudget = 2'000'000
+    );
+
+    size_t tokenBudget() const;
+
+    // Estimated cost of an article, words of text up to the embedder's sequence length plus a fixed per-article overhead
+    static size_t estimateTokens(std::string_view text);
+
+    // Record a flushed batch and adjust the budget for the next one
+    void record(size_t articles, size_t tokens, std::chrono::duration<double> elapsed);
+
+    void printSummary() const;
+
+private:
+    size_t budget;
+    size_t memoryLimit;
+    size_t minBudget;
+    size_t maxBudget;
+
+    double lastThroughput = 0.0;    // tokens per second of the previous batch
+    int direction = 1;              // +1 growing the budget, -1 shrinking it
+
+	// Reporting
+    size_t batches = 0;
+    size_t totalArticles = 0;
+    size_t minArticles = 0;
+    size_t maxArticles = 0;
+    size_t minChosenBudget = 0;
+    size_t maxChosenBudget = 0;
+};
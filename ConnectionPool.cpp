@@ -0,0 +1,70 @@
+#include "ConnectionPool.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pqxx/connection.hxx>
+
+// Constructor, opens all connections up front
+ConnectionPool::ConnectionPool(const std::string& connString, size_t size)
+{
+    if (size == 0) size = 1;
+
+    connections.reserve(size);
+    idle.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        connections.push_back(std::make_unique<pqxx::connection>(connString));
+        idle.push_back(connections.back().get());
+    }
+}
+
+// Lease a connection, waits if all are in use
+ConnectionPool::Lease ConnectionPool::acquire(Priority priority)
+{
+    std::unique_lock lock(mutex);
+
+    if (priority == Priority::High) {
+        highWaiting++;
+        available.wait(lock, [this] { return !idle.empty(); });
+        highWaiting--;
+    }
+    else {
+        // low priority never takes the last free connection and yields to waiting queries
+        size_t reserved = connections.size() > 1 ? 1 : 0;
+        available.wait(lock, [this, reserved] { return idle.size() > reserved && highWaiting == 0; });
+    }
+
+    pqxx::connection* conn = idle.back();
+    idle.pop_back();
+    return Lease(*this, conn);
+}
+
+size_t ConnectionPool::size() const
+{
+    return connections.size();
+}
+
+// Return a connection to the pool
+void ConnectionPool::release(pqxx::connection* conn)
+{
+    {
+        std::lock_guard lock(mutex);
+        idle.push_back(conn);
+    }
+    available.notify_all();
+}
+
+ConnectionPool::Lease::Lease(ConnectionPool& pool, pqxx::connection* conn)
+    : pool(&pool), conn(conn) {
+}
+
+ConnectionPool::Lease::Lease(Lease&& other) noexcept
+    : pool(other.pool), conn(std::exchange(other.conn, nullptr)) {
+}
+
+ConnectionPool::Lease::~Lease()
+{
+    if (conn) pool->release(conn);
+}
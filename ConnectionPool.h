@@ -0,0 +1,52 @@
+#pragma once
+#include "PriorityScheduler.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <pqxx/pqxx>
+
+/*
+This class manages a fixed set of PostgreSQL connections shared between threads.
+A pqxx::connection is not thread safe, so each caller leases one for the duration of its work.
+Queries lease with high priority: they are served before waiting ingest work, and one connection is always kept for them.
+*/
+
+class ConnectionPool {
+public:
+    ConnectionPool(
+        const std::string& connString,
+        size_t size
+    );
+
+    // RAII handle to a leased connection, returned to the pool on destruction
+    class Lease {
+    public:
+        Lease(ConnectionPool& pool, pqxx::connection* conn);
+        Lease(Lease&& other) noexcept;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease();
+
+        pqxx::connection& operator*() const { return *conn; }
+        pqxx::connection* operator->() const { return conn; }
+
+    private:
+        ConnectionPool* pool;
+        pqxx::connection* conn;
+    };
+
+    Lease acquire(Priority priority = Priority::High);  // Blocks until a connection is free
+    size_t size() const;
+
+private:
+    void release(pqxx::connection* conn);
+
+    std::vector<std::unique_ptr<pqxx::connection>> connections;
+    std::vector<pqxx::connection*> idle;    // connections currently free
+    size_t highWaiting = 0;                 // queries waiting for a connection
+    std::mutex mutex;
+    std::condition_variable available;
+};
@@ -0,0 +1,358 @@
+#include "CorpusFile.h"
+#include "TextUtils.h"
+#include "Trace.h"
+
+#include <bzlib.h>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+constexpr char CORPUS_MAGIC[8] = { 'E', 'D', 'B', 'C', 'O', 'R', 'P', '\0' };
+constexpr size_t CORPUS_HEADER_BYTES = 40;
+constexpr size_t CORPUS_INDEX_ENTRY_BYTES = 16;
+constexpr size_t CORPUS_BLOCK_BYTES = 64 * 1024 * 1024;    // text bytes that close a block early
+constexpr size_t TOKEN_STAT_BYTES = sizeof(int64_t) + sizeof(int16_t);
+
+template <typename T>
+static void writeValue(std::string& out, T v)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &v, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+// Read a T at pos, advancing pos, returns false if out of bounds
+template <typename T>
+static bool readValue(std::string_view in, size_t& pos, T& v)
+{
+    if (pos > in.size() || in.size() - pos < sizeof(T)) return false;
+    std::memcpy(&v, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+// Append a u32 length prefixed value
+static void writeBytes(std::string& out, std::string_view bytes)
+{
+    writeValue(out, static_cast<uint32_t>(bytes.size()));
+    out.append(bytes);
+}
+
+// Read a u32 length prefixed value as a view into in
+static bool readBytes(std::string_view in, size_t& pos, std::string_view& bytes)
+{
+    uint32_t len = 0;
+    if (!readValue(in, pos, len) || in.size() - pos < len) return false;
+    bytes = in.substr(pos, len);
+    pos += len;
+    return true;
+}
+
+std::vector<TokenStat> decodeTokenStats(std::string_view packed)
+{
+    std::vector<TokenStat> out(packed.size() / TOKEN_STAT_BYTES);
+    const char* p = packed.data();
+    for (auto& stat : out) {
+        std::memcpy(&stat.hash, p, sizeof(stat.hash));
+        std::memcpy(&stat.freq, p + sizeof(stat.hash), sizeof(stat.freq));
+        p += TOKEN_STAT_BYTES;
+    }
+    return out;
+}
+
+// Constructor, the header is rewritten with the final counts by finish()
+CorpusWriter::CorpusWriter(const std::string& path, bool compress, uint32_t blockArticles)
+    : out(path, std::ios::binary | std::ios::trunc),
+    path(path),
+    compress(compress),
+    blockArticles(blockArticles ? blockArticles : CORPUS_BLOCK_ARTICLES)
+{
+    if (!out) throw std::runtime_error("Could not create corpus file " + path);
+    writeHeader();
+}
+
+CorpusWriter::~CorpusWriter()
+{
+    try {
+        finish();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error finishing corpus file " << path << ": " << e.what() << std::endl;
+    }
+}
+
+void CorpusWriter::add(std::string_view title, std::string_view text, const ArticleMeta& meta)
+{
+    if (finished) throw std::logic_error("Corpus file is already finished");
+
+    writeBytes(titles, title);
+    writeBytes(texts, text);
+
+    auto tokenStats = computeTokenStats(text);
+    writeValue(stats, static_cast<uint32_t>(tokenStats.size() * TOKEN_STAT_BYTES));
+    for (const auto& stat : tokenStats) {
+        writeValue(stats, stat.hash);
+        writeValue(stats, stat.freq);
+    }
+
+    writeValue(metas, meta.ns);
+    writeValue(metas, meta.length);
+    writeBytes(metas, meta.timestamp);
+    writeBytes(metas, meta.categories);
+
+    ++pending;
+    ++articles;
+    if (pending >= blockArticles || texts.size() >= CORPUS_BLOCK_BYTES) flushBlock();
+}
+
+void CorpusWriter::finish()
+{
+    if (finished) return;
+    finished = true;
+
+    flushBlock();
+
+    indexOffset = static_cast<uint64_t>(out.tellp());
+    std::string buffer;
+    buffer.reserve(index.size() * CORPUS_INDEX_ENTRY_BYTES);
+    for (const auto& e : index) {
+        writeValue(buffer, e.offset);
+        writeValue(buffer, e.articles);
+        writeValue(buffer, e.bytes);
+    }
+    out.write(buffer.data(), buffer.size());
+
+    out.seekp(0);
+    writeHeader();
+    out.close();
+    if (!out) throw std::runtime_error("Could not write corpus file " + path);
+}
+
+uint64_t CorpusWriter::articleCount() const
+{
+    return articles;
+}
+
+void CorpusWriter::flushBlock()
+{
+    if (pending == 0) return;
+    TRACE_SCOPE("CorpusWriter::flushBlock");
+
+    uint64_t offset = static_cast<uint64_t>(out.tellp());
+    writeColumn(titles);
+    writeColumn(texts);
+    writeColumn(stats);
+    writeColumn(metas);
+    uint64_t bytes = static_cast<uint64_t>(out.tellp()) - offset;
+
+    index.push_back({ offset, pending, static_cast<uint32_t>(bytes) });
+    titles.clear();
+    texts.clear();
+    stats.clear();
+    metas.clear();
+    pending = 0;
+}
+
+// Writes stored size, raw size and data of one column
+void CorpusWriter::writeColumn(const std::string& raw)
+{
+    if (raw.size() > std::numeric_limits<uint32_t>::max() / 2) {
+        throw std::runtime_error("Corpus block column is too large");
+    }
+
+    std::string header;
+    if (!compress) {
+        writeValue(header, static_cast<uint32_t>(raw.size()));
+        writeValue(header, static_cast<uint32_t>(raw.size()));
+        out.write(header.data(), header.size());
+        out.write(raw.data(), raw.size());
+        return;
+    }
+
+	// bzip2 worst case is 1% plus 600 bytes larger than the input
+    std::string packed(raw.size() + raw.size() / 100 + 600, '\0');
+    unsigned int packedSize = static_cast<unsigned int>(packed.size());
+    int rc = BZ2_bzBuffToBuffCompress(packed.data(), &packedSize,
+        const_cast<char*>(raw.data()), static_cast<unsigned int>(raw.size()), 9, 0, 0);
+    if (rc != BZ_OK) throw std::runtime_error("bzip2 compression failed: " + std::to_string(rc));
+
+    writeValue(header, static_cast<uint32_t>(packedSize));
+    writeValue(header, static_cast<uint32_t>(raw.size()));
+    out.write(header.data(), header.size());
+    out.write(packed.data(), packedSize);
+}
+
+void CorpusWriter::writeHeader()
+{
+    std::string header(CORPUS_MAGIC, sizeof(CORPUS_MAGIC));
+    writeValue(header, CORPUS_VERSION);
+    writeValue(header, compress ? CORPUS_FLAG_BZIP2 : 0u);
+    writeValue(header, articles);
+    writeValue(header, static_cast<uint64_t>(index.size()));
+    writeValue(header, indexOffset);
+    out.write(header.data(), header.size());
+}
+
+// Convert JSON files to one corpus file
+uint64_t CorpusWriter::convertJsonDirectory(
+    const std::string& jsonPath,
+    const std::string& outPath,
+    bool compress)
+{
+    CorpusWriter writer(outPath, compress);
+
+    for (const auto& entry : fs::directory_iterator(jsonPath)) {
+        if (entry.path().extension() != ".json") continue;
+
+        std::ifstream file(entry.path());
+        if (!file) continue;
+
+        std::string line;
+        while (std::getline(file, line)) {
+            json j = json::parse(line, nullptr, false);
+            if (j.is_discarded()) continue;
+
+            std::string text = j.value("text", "");
+            if (text.find("#REDIRECT") != std::string::npos) continue;
+
+            std::string timestamp = j.value("timestamp", "");
+            std::string categories;
+            if (j.contains("categories") && j["categories"].is_array()) {
+                for (const auto& c : j["categories"]) {
+                    if (!c.is_string()) continue;
+                    if (!categories.empty()) categories.push_back('\n');
+                    categories += c.get<std::string>();
+                }
+            }
+            ArticleMeta meta{ j.value("ns", 0), j.value("length", 0), timestamp, categories };
+
+            writer.add(j.value("title", ""), text, meta);
+        }
+        std::cout << "Converted " << entry.path().filename().string() << ", "
+            << writer.articleCount() << " articles so far" << std::endl;
+    }
+
+    writer.finish();
+    return writer.articleCount();
+}
+
+// Constructor, maps the file and loads the block index
+CorpusReader::CorpusReader(const std::string& path)
+    : file(path, MapAdvice::Sequential)
+{
+    std::string_view data = file.view();
+    if (data.size() < CORPUS_HEADER_BYTES || std::memcmp(data.data(), CORPUS_MAGIC, sizeof(CORPUS_MAGIC)) != 0) {
+        throw std::runtime_error("Not a corpus file: " + path);
+    }
+
+    size_t pos = sizeof(CORPUS_MAGIC);
+    uint64_t blocks = 0, indexOffset = 0;
+    readValue(data, pos, version);
+    readValue(data, pos, flags);
+    readValue(data, pos, articles);
+    readValue(data, pos, blocks);
+    readValue(data, pos, indexOffset);
+
+    if (version < 1 || version > CORPUS_VERSION) {
+        throw std::runtime_error("Unsupported corpus version " + std::to_string(version) + " in " + path);
+    }
+    if (indexOffset < CORPUS_HEADER_BYTES || indexOffset > data.size()
+        || (data.size() - indexOffset) / CORPUS_INDEX_ENTRY_BYTES < blocks) {
+        throw std::runtime_error("Corpus file is truncated or was not finished: " + path);
+    }
+
+    index.resize(blocks);
+    pos = indexOffset;
+    for (auto& e : index) {
+        readValue(data, pos, e.offset);
+        readValue(data, pos, e.articles);
+        readValue(data, pos, e.bytes);
+        if (e.offset < CORPUS_HEADER_BYTES || e.offset > indexOffset || indexOffset - e.offset < e.bytes) {
+            throw std::runtime_error("Corpus block index is corrupt: " + path);
+        }
+    }
+}
+
+size_t CorpusReader::blockCount() const
+{
+    return index.size();
+}
+
+uint64_t CorpusReader::articleCount() const
+{
+    return articles;
+}
+
+bool CorpusReader::compressed() const
+{
+    return flags & CORPUS_FLAG_BZIP2;
+}
+
+// Decode block i, uncompressed columns are views into the mapping
+CorpusBlock CorpusReader::readBlock(size_t i) const
+{
+    TRACE_SCOPE("CorpusReader::readBlock");
+    const BlockEntry& e = index.at(i);
+    std::string_view data = file.view().substr(e.offset, e.bytes);
+
+    CorpusBlock block;
+    block.buffers.reserve(4);   // columns point into the buffers, they must not move
+
+    std::string_view columns[4];
+    size_t columnCount = version >= 2 ? 4 : 3;
+    size_t pos = 0;
+    for (size_t c = 0; c < columnCount; ++c) {
+        std::string_view& column = columns[c];
+        uint32_t stored = 0, raw = 0;
+        std::string_view bytes;
+        if (!readValue(data, pos, stored) || !readValue(data, pos, raw) || data.size() - pos < stored) {
+            throw std::runtime_error("Corpus block " + std::to_string(i) + " is corrupt");
+        }
+        bytes = data.substr(pos, stored);
+        pos += stored;
+
+        if (!compressed()) {
+            column = bytes;
+            continue;
+        }
+
+        std::string& buffer = block.buffers.emplace_back(raw, '\0');
+        unsigned int rawSize = raw;
+        int rc = BZ2_bzBuffToBuffDecompress(buffer.data(), &rawSize,
+            const_cast<char*>(bytes.data()), stored, 0, 0);
+        if (rc != BZ_OK || rawSize != raw) {
+            throw std::runtime_error("bzip2 decompression of corpus block " + std::to_string(i) + " failed");
+        }
+        column = buffer;
+    }
+
+    block.articles.resize(e.articles);
+    size_t titlePos = 0, textPos = 0, statPos = 0, metaPos = 0;
+    for (auto& article : block.articles) {
+        if (!readBytes(columns[0], titlePos, article.title)
+            || !readBytes(columns[1], textPos, article.text)
+            || !readBytes(columns[2], statPos, article.tokenStats)) {
+            throw std::runtime_error("Corpus block " + std::to_string(i) + " has fewer articles than indexed");
+        }
+        if (columnCount < 4) continue;
+
+        ArticleMeta& meta = article.meta;
+        if (!readValue(columns[3], metaPos, meta.ns)
+            || !readValue(columns[3], metaPos, meta.length)
+            || !readBytes(columns[3], metaPos, meta.timestamp)
+            || !readBytes(columns[3], metaPos, meta.categories)) {
+            throw std::runtime_error("Corpus block " + std::to_string(i) + " has fewer metadata entries than indexed");
+        }
+    }
+    return block;
+}
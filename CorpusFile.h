@@ -0,0 +1,117 @@
+#pragma once
+#include "MappedFile.h"
+#include "PageItem.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+Binary columnar corpus format, written once from the parsed JSON files and memory-mapped on re-ingestion.
+Articles are grouped into blocks, each block stores a title, a text, a token stats and a metadata column, optionally bzip2 compressed.
+Values are length prefixed, token stats are precomputed with computeTokenStats so ingest skips JSON parsing and tokenizing.
+Uncompressed blocks are read zero-copy straight out of the mapping.
+
+Layout, integers in host byte order like EmbeddingProtocol:
+    header   "EDBCORP\0", u32 version, u32 flags, u64 articles, u64 blocks, u64 index offset
+    block    4 x column (u32 stored bytes, u32 raw bytes, data), version 1 files have no metadata column
+    meta     per article i32 namespace, i32 length, timestamp value, categories value
+    index    per block u64 offset, u32 articles, u32 bytes
+*/
+
+constexpr uint32_t CORPUS_VERSION = 2;             // 2 added the metadata column, version 1 files are still read
+constexpr uint32_t CORPUS_FLAG_BZIP2 = 1;           // columns are bzip2 compressed
+constexpr uint32_t CORPUS_BLOCK_ARTICLES = 1024;    // articles per block
+constexpr const char* CORPUS_EXTENSION = ".edbc";
+
+// Views of one article in a block, valid while the block and reader are alive
+struct CorpusArticle {
+    std::string_view title;
+    std::string_view text;
+    std::string_view tokenStats;    // packed (i64 hash, i16 freq) records
+    ArticleMeta meta;
+};
+
+// Unpack a token stats column value, also used on PageItem::tokenStats views
+std::vector<TokenStat> decodeTokenStats(std::string_view packed);
+
+// One decoded block, only owns memory when the file is compressed
+struct CorpusBlock {
+    std::vector<CorpusArticle> articles;
+    std::vector<std::string> buffers;   // decompressed columns
+};
+
+class CorpusWriter {
+public:
+    CorpusWriter(
+        const std::string& path,
+        bool compress = false,
+        uint32_t blockArticles = CORPUS_BLOCK_ARTICLES
+    );
+    ~CorpusWriter();
+
+    void add(std::string_view title, std::string_view text, const ArticleMeta& meta = {});
+    void finish();      // writes the last block, the index and the final header
+
+    uint64_t articleCount() const;
+
+    // Convert the JSON files of a WikipediaParse.py output directory, redirects are dropped
+    static uint64_t convertJsonDirectory(
+        const std::string& jsonPath,
+        const std::string& outPath,
+        bool compress = false
+    );
+
+private:
+    struct BlockEntry {
+        uint64_t offset;
+        uint32_t articles;
+        uint32_t bytes;
+    };
+
+    void flushBlock();
+    void writeColumn(const std::string& raw);
+    void writeHeader();
+
+    std::ofstream out;
+    std::string path;
+    bool compress;
+    uint32_t blockArticles;
+    bool finished = false;
+
+    std::string titles;     // current block columns
+    std::string texts;
+    std::string stats;
+    std::string metas;
+    uint32_t pending = 0;   // articles in current block
+
+    uint64_t articles = 0;
+    uint64_t indexOffset = 0;   // 0 until finish(), so an unfinished file is rejected by the reader
+    std::vector<BlockEntry> index;
+};
+
+class CorpusReader {
+public:
+    explicit CorpusReader(const std::string& path);    // throws std::runtime_error on a malformed file
+
+    size_t blockCount() const;
+    uint64_t articleCount() const;
+    bool compressed() const;
+
+    CorpusBlock readBlock(size_t i) const;
+
+private:
+    struct BlockEntry {
+        uint64_t offset;
+        uint32_t articles;
+        uint32_t bytes;
+    };
+
+    MappedFile file;
+    uint32_t version = 0;
+    uint32_t flags = 0;
+    uint64_t articles = 0;
+    std::vector<BlockEntry> index;
+};
@@ -0,0 +1,109 @@
+#include "CpuBudget.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Logical processors the process may run on
+static std::vector<int> allowedCpus()
+{
+    std::vector<int> cpus;
+#ifdef _WIN32
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+        for (int i = 0; i < static_cast<int>(sizeof(DWORD_PTR) * 8); ++i) {
+            if (processMask & (static_cast<DWORD_PTR>(1) << i)) cpus.push_back(i);
+        }
+    }
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &set)) cpus.push_back(i);
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        unsigned n = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < n; ++i) cpus.push_back(static_cast<int>(i));
+    }
+    return cpus;
+}
+
+void CpuBudget::configure(size_t cores, bool pinThreads)
+{
+    configuredCores = cores;
+    pin = pinThreads;
+}
+
+size_t CpuBudget::cores()
+{
+    size_t available = allowedCpus().size();
+    size_t requested = configuredCores.load();
+    return requested == 0 ? available : std::min(requested, available);
+}
+
+size_t CpuBudget::poolCores()
+{
+    size_t total = cores();
+    if (total < 2) return 0;
+    size_t share = static_cast<size_t>(total * POOL_CORE_SHARE + 0.5);
+    return std::clamp<size_t>(share, 1, total - 1);
+}
+
+size_t CpuBudget::inferenceCores()
+{
+    return std::max<size_t>(cores() - poolCores(), 1);
+}
+
+bool CpuBudget::pinThreads()
+{
+    return pin.load();
+}
+
+std::vector<int> CpuBudget::budgetCpus()
+{
+    std::vector<int> cpus = allowedCpus();
+    cpus.resize(std::min(cpus.size(), cores()));
+    return cpus;
+}
+
+bool CpuBudget::pinCurrentThread(size_t slot)
+{
+    if (!pin) return false;
+
+    std::vector<int> cpus = budgetCpus();
+    int cpu = cpus[slot % cpus.size()];
+#ifdef _WIN32
+    if (cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8)) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+// ORT numbers processors from 1, one ';' separated entry per thread after the caller
+std::string CpuBudget::onnxAffinity(size_t threads)
+{
+    std::vector<int> cpus = budgetCpus();
+    std::string out;
+    for (size_t t = 1; t < threads; ++t) {
+        if (!out.empty()) out += ';';
+        out += std::to_string(cpus[t % cpus.size()] + 1);
+    }
+    return out;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+Process-wide CPU budget split between the ONNX Runtime global thread pool and ThreadPool::shared().
+Configured once at startup, before the first ONNXEmbedder or shared pool is created. Ingest runs both pools at the same
+time, so each gets its own share of the cores and together they never run more busy threads than cores it was given. Pinning binds threads to the budgeted cores, taken from the cores the process
+is allowed to run on (taskset, cgroup cpusets or Windows affinity masks are respected).
+*/
+
+constexpr double POOL_CORE_SHARE = 0.25;   // share of the budget for ThreadPool::shared(), the rest runs inference
+
+class CpuBudget {
+public:
+    // cores = 0 uses every core available to the process
+    static void configure(size_t cores, bool pinThreads);
+
+    static size_t cores();              // at least 1
+    static size_t inferenceCores();     // ORT intra-op threads including the caller, at least 1
+    static size_t poolCores();          // ThreadPool::shared() workers, 0 on a single core
+    static bool pinThreads();
+
+    // Pin the calling thread to budget core slot % cores(), does nothing unless pinning is enabled
+    // Slots below inferenceCores() belong to ORT, the pool's workers take the slots after them
+    static bool pinCurrentThread(size_t slot);
+
+    // ORT intra-op affinity string for a pool of threads, the first thread is the caller and is not listed
+    static std::string onnxAffinity(size_t threads);
+
+private:
+    static std::vector<int> budgetCpus();   // logical processor ids of the budget
+
+    static inline std::atomic<size_t> configuredCores{ 0 };
+    static inline std::atomic<bool> pin{ false };
+};
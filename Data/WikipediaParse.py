@@ -11,7 +11,8 @@ os.makedirs(output_dir, exist_ok=True)
 
 '''
 This file is used to extract Wikipedia articles from a compressed XML dump file.
-It processes the dump, extracts article titles and text, and saves them in JSON format.
+It processes the dump, extracts article titles, text and metadata, and saves them in JSON format.
+Metadata (namespace, last revision timestamp, categories, wikitext length) is used for filtered search.
 '''
 
 PAGES_PER_FILE = 10000 # number of pages per output JSON file
@@ -61,6 +62,17 @@ def clean_wiki_text(text: str) -> str:
 
     return text
 
+CATEGORY_RE = re.compile(r"\[\[Category:([^\]|]+)", flags=re.IGNORECASE)
+
+def extract_categories(text: str) -> list:
+    # Lowercase category names in order of appearance, duplicates dropped
+    categories = []
+    for match in CATEGORY_RE.finditer(text):
+        name = " ".join(match.group(1).replace("_", " ").split()).lower()
+        if name and name not in categories:
+            categories.append(name)
+    return categories
+
 def write_json_file(pages, file_idx):
     filename = os.path.join(output_dir, f"wiki_{file_idx:04d}.json")
     with open(filename, "w", encoding="utf-8") as f:
@@ -93,13 +105,18 @@ with bz2.open(dump_file, "rt", encoding="utf-8") as f:
                     if text_content.lower().startswith("#redirect"):
                         continue
 
+                    categories = extract_categories(text_content)   # before cleaning, which strips category links
                     cleaned_text = clean_wiki_text(text_content)
                     cleaned_text = cleaned_text.lower()
                     cleaned_text = cleaned_text.replace("’", "'")
                     
                     page_dict = {
                         "title": title,
-                        "text": cleaned_text
+                        "text": cleaned_text,
+                        "ns": int(root.findtext("ns") or 0),
+                        "timestamp": root.findtext("revision/timestamp") or "",
+                        "categories": categories,
+                        "length": len(text_content)
                     }
                     pages_in_file.append(page_dict)
 
@@ -0,0 +1,149 @@
+#include "EmbeddingDispatcher.h"
+#include "EmbeddingProtocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <httplib.h>
+
+constexpr auto ENDPOINT_BACKOFF = std::chrono::seconds(5);  // how long a failing endpoint is avoided
+
+// Constructor, creates one HTTP client per in-flight slot of each endpoint
+EmbeddingDispatcher::EmbeddingDispatcher(
+    const std::vector<std::string>& endpointNames,
+    size_t maxInFlight,
+    size_t subBatchSize,
+    int maxRetries)
+    : subBatchSize(std::max<size_t>(subBatchSize, 1)),
+    maxRetries(maxRetries)
+{
+    if (endpointNames.empty()) {
+        throw std::invalid_argument("EmbeddingDispatcher needs at least one endpoint");
+    }
+
+    for (const auto& name : endpointNames) {
+        auto colon = name.rfind(':');
+        std::string host = colon == std::string::npos ? name : name.substr(0, colon);
+        int port = colon == std::string::npos ? 8000 : std::stoi(name.substr(colon + 1));
+
+        auto endpoint = std::make_unique<Endpoint>();
+        endpoint->name = name;
+        for (size_t i = 0; i < std::max<size_t>(maxInFlight, 1); ++i) {
+            auto client = std::make_unique<httplib::Client>(host, port);
+            client->set_connection_timeout(8);
+            client->set_read_timeout(8);
+            client->set_keep_alive(true);
+            endpoint->idle.push_back(client.get());
+            endpoint->clients.push_back(std::move(client));
+        }
+        slotCount += endpoint->clients.size();
+        endpoints.push_back(std::move(endpoint));
+    }
+}
+
+size_t EmbeddingDispatcher::endpointCount() const
+{
+    return endpoints.size();
+}
+
+// Split texts into sub-batches and embed them concurrently, each into its own rows of the result
+// One sender thread per in-flight slot at most, senders take the next sub-batch until none are left
+EmbeddingMatrix EmbeddingDispatcher::embedBatch(const std::vector<std::string_view>& texts, size_t dim)
+{
+    EmbeddingMatrix result(texts.size(), dim);
+
+    size_t parts = (texts.size() + subBatchSize - 1) / subBatchSize;
+    std::atomic<size_t> nextPart{ 0 };
+    auto send = [&] {
+        size_t p;
+        while ((p = nextPart.fetch_add(1)) < parts) {
+            size_t start = p * subBatchSize;
+            size_t end = std::min(start + subBatchSize, texts.size());
+            embedSubBatch(std::vector<std::string_view>(texts.begin() + start, texts.begin() + end), result, start);
+        }
+    };
+
+    std::vector<std::future<void>> senders;
+    for (size_t i = 0; i < std::min(parts, slotCount); ++i) {
+        senders.push_back(std::async(std::launch::async, send));
+    }
+
+    for (auto& f : senders) f.get();
+    return result;
+}
+
+// Send one sub-batch, retrying on other endpoints when a request fails
+void EmbeddingDispatcher::embedSubBatch(const std::vector<std::string_view>& texts, EmbeddingMatrix& out, size_t firstRow)
+{
+    std::string body = encodeEmbedRequest(texts);
+    const Endpoint* lastFailed = nullptr;
+
+    for (int attempt = 0; attempt <= maxRetries; ++attempt) {
+        Slot slot = acquire(lastFailed);
+
+        auto res = slot.client->Post(EMBED_PATH, body, EMBED_CONTENT_TYPE);
+        bool ok = res && res->status == 200
+            && decodeEmbedResponse(res->body, texts.size(), out, firstRow);
+
+        release(slot, ok);
+        if (ok) return;
+
+        std::cerr << "Embedding request to " << slot.endpoint->name << " failed (attempt "
+            << attempt + 1 << " of " << maxRetries + 1 << ")\n";
+        lastFailed = slot.endpoint;
+    }
+
+    std::fill(out.valid.begin() + firstRow, out.valid.begin() + firstRow + texts.size(), 0);
+}
+
+// Wait for a free slot, preferring healthy endpoints with the most idle clients
+EmbeddingDispatcher::Slot EmbeddingDispatcher::acquire(const Endpoint* avoid)
+{
+    std::unique_lock lock(mutex);
+
+    while (true) {
+        auto now = Clock::now();
+        Endpoint* best = nullptr;
+        int bestRank = -1;
+
+        for (auto& e : endpoints) {
+            if (e->idle.empty()) continue;
+
+            // healthy endpoints first, then not the one that just failed, then least loaded
+            int rank = static_cast<int>(e->idle.size());
+            if (e.get() != avoid) rank += 1'000;
+            if (e->backoffUntil <= now) rank += 1'000'000;
+
+            if (rank > bestRank) {
+                best = e.get();
+                bestRank = rank;
+            }
+        }
+
+        if (best) {
+            httplib::Client* client = best->idle.back();
+            best->idle.pop_back();
+            return { best, client };
+        }
+
+        available.wait(lock);
+    }
+}
+
+// Return a slot, failed endpoints are backed off
+void EmbeddingDispatcher::release(Slot slot, bool ok)
+{
+    {
+        std::lock_guard lock(mutex);
+        slot.endpoint->idle.push_back(slot.client);
+        if (!ok) slot.endpoint->backoffUntil = Clock::now() + ENDPOINT_BACKOFF;
+    }
+    available.notify_one();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "EmbeddingMatrix.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <httplib.h>
+
+/*
+This class spreads embedding batches over a set of EmbeddingWorker endpoints.
+Batches are split into sub-batches and sent to the least loaded endpoint, each endpoint has a cap on in-flight requests.
+Failed requests are retried on another endpoint, an endpoint that fails is avoided for a short backoff.
+*/
+
+class EmbeddingDispatcher {
+public:
+    EmbeddingDispatcher(
+        const std::vector<std::string>& endpoints,     // "host:port"
+        size_t maxInFlight = 2,                         // concurrent requests per endpoint
+        size_t subBatchSize = 32,                       // texts per request
+        int maxRetries = 2                              // extra attempts per sub-batch
+    );
+
+	// Embed texts across workers, responses are decoded straight into the rows, failed texts are marked invalid
+    EmbeddingMatrix embedBatch(
+        const std::vector<std::string_view>& texts,
+        size_t dim
+    );
+
+    size_t endpointCount() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Endpoint {
+        std::string name;
+        std::vector<std::unique_ptr<httplib::Client>> clients;  // one client per in-flight slot
+        std::vector<httplib::Client*> idle;                      // clients not currently sending
+        Clock::time_point backoffUntil{};                        // avoided until this time after a failure
+    };
+
+    struct Slot {
+        Endpoint* endpoint;
+        httplib::Client* client;
+    };
+
+    std::vector<std::unique_ptr<Endpoint>> endpoints;
+    size_t slotCount = 0;               // in-flight slots over all endpoints, also the sender threads per batch
+    size_t subBatchSize;
+    int maxRetries;
+
+    std::mutex mutex;
+    std::condition_variable available;
+
+    Slot acquire(const Endpoint* avoid);
+    void release(Slot slot, bool ok);
+
+    // Embed texts into rows firstRow.. of out
+    void embedSubBatch(
+        const std::vector<std::string_view>& texts,
+        EmbeddingMatrix& out,
+        size_t firstRow
+    );
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+Embeddings of a batch in one row-major float buffer, one row per text.
+Rows are written in place by the embedder or decoded straight into by the worker dispatcher,
+rows whose embedding failed are marked invalid instead of being left empty.
+*/
+
+struct EmbeddingMatrix {
+    size_t dim = 0;
+    std::vector<float> values;      // rows x dim
+    std::vector<uint8_t> valid;     // per row, 0 when its embedding failed
+
+    EmbeddingMatrix() = default;
+    EmbeddingMatrix(size_t rows, size_t dim)
+        : dim(dim), values(rows * dim, 0.0f), valid(rows, 1) {
+    }
+
+    size_t rows() const { return valid.size(); }
+    float* row(size_t i) { return values.data() + i * dim; }
+    const float* row(size_t i) const { return values.data() + i * dim; }
+
+    // Keep the first rows, used after failed rows were compacted away
+    void truncate(size_t rows)
+    {
+        valid.resize(rows);
+        values.resize(rows * dim);
+    }
+};
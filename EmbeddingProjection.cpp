@@ -0,0 +1,206 @@
+#include "EmbeddingProjection.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+constexpr int PCA_ITERATIONS = 100;     // subspace iterations, the embedding spectrum decays slowly
+
+// Constructor
+EmbeddingProjection::EmbeddingProjection(
+    size_t inDim,
+    size_t outDim,
+    std::vector<float> mean,
+    std::vector<float> components)
+    : inDim(inDim),
+    outDim(outDim),
+    mean(std::move(mean)),
+    components(std::move(components))
+{
+    if (this->mean.size() != inDim || this->components.size() != inDim * outDim) {
+        throw std::invalid_argument("Projection size does not match its dimensions");
+    }
+}
+
+// Learn a PCA projection using subspace iteration on the sample covariance
+EmbeddingProjection EmbeddingProjection::learn(
+    const std::vector<std::vector<float>>& samples,
+    size_t outDim)
+{
+    if (samples.size() < 2) {
+        throw std::invalid_argument("Need at least two samples to learn a projection");
+    }
+
+    size_t n = samples.size();
+    size_t d = samples[0].size();
+    if (outDim == 0 || outDim > d) {
+        throw std::invalid_argument("Reduced dimension must be between 1 and the embedding dimension");
+    }
+
+	// Mean of samples
+    std::vector<double> mu(d, 0.0);
+    for (const auto& s : samples) {
+        if (s.size() != d) throw std::invalid_argument("Samples have mixed dimensions");
+        for (size_t j = 0; j < d; ++j) mu[j] += s[j];
+    }
+    for (auto& m : mu) m /= static_cast<double>(n);
+
+	// Covariance, only the upper triangle is accumulated then mirrored
+    std::vector<double> cov(d * d, 0.0);
+    std::vector<double> centered(d);
+    for (const auto& s : samples) {
+        for (size_t j = 0; j < d; ++j) centered[j] = s[j] - mu[j];
+        for (size_t a = 0; a < d; ++a) {
+            double ca = centered[a];
+            double* row = &cov[a * d];
+            for (size_t b = a; b < d; ++b) row[b] += ca * centered[b];
+        }
+    }
+    double trace = 0.0;
+    for (size_t a = 0; a < d; ++a) {
+        for (size_t b = a; b < d; ++b) {
+            cov[a * d + b] /= static_cast<double>(n - 1);
+            cov[b * d + a] = cov[a * d + b];
+        }
+        trace += cov[a * d + a];
+    }
+
+	// Subspace iteration, basis is stored as outDim rows of length d
+    std::mt19937_64 rng(7);
+    std::normal_distribution<double> gauss(0.0, 1.0);
+    std::vector<double> basis(outDim * d);
+    for (auto& x : basis) x = gauss(rng);
+
+    std::vector<double> next(outDim * d);
+
+    auto orthonormalize = [&](std::vector<double>& m) {
+        for (size_t i = 0; i < outDim; ++i) {
+            double* vi = &m[i * d];
+            for (size_t k = 0; k < i; ++k) {
+                const double* vk = &m[k * d];
+                double dot = 0.0;
+                for (size_t j = 0; j < d; ++j) dot += vi[j] * vk[j];
+                for (size_t j = 0; j < d; ++j) vi[j] -= dot * vk[j];
+            }
+            double norm = 0.0;
+            for (size_t j = 0; j < d; ++j) norm += vi[j] * vi[j];
+            norm = std::sqrt(norm);
+            if (norm > 0.0) {
+                for (size_t j = 0; j < d; ++j) vi[j] /= norm;
+            }
+        }
+    };
+
+    orthonormalize(basis);
+    for (int it = 0; it < PCA_ITERATIONS; ++it) {
+        for (size_t i = 0; i < outDim; ++i) {
+            const double* v = &basis[i * d];
+            double* out = &next[i * d];
+            for (size_t a = 0; a < d; ++a) {
+                const double* row = &cov[a * d];
+                double sum = 0.0;
+                for (size_t b = 0; b < d; ++b) sum += row[b] * v[b];
+                out[a] = sum;
+            }
+        }
+        orthonormalize(next);
+        std::swap(basis, next);
+    }
+
+	// Variance captured by the basis, sum of v^T C v
+    double kept = 0.0;
+    for (size_t i = 0; i < outDim; ++i) {
+        const double* v = &basis[i * d];
+        for (size_t a = 0; a < d; ++a) {
+            const double* row = &cov[a * d];
+            double sum = 0.0;
+            for (size_t b = 0; b < d; ++b) sum += row[b] * v[b];
+            kept += v[a] * sum;
+        }
+    }
+
+    EmbeddingProjection projection(
+        d,
+        outDim,
+        std::vector<float>(mu.begin(), mu.end()),
+        std::vector<float>(basis.begin(), basis.end())
+    );
+    projection.explainedVariance = trace > 0.0 ? kept / trace : 0.0;
+    return projection;
+}
+
+// Project a full embedding to the reduced dimension
+std::vector<float> EmbeddingProjection::project(const std::vector<float>& v) const
+{
+    return project(v.data(), v.size());
+}
+
+std::vector<float> EmbeddingProjection::project(const float* v, size_t n) const
+{
+    if (n != inDim) return {};
+
+    std::vector<float> out(outDim, 0.0f);
+    for (size_t i = 0; i < outDim; ++i) {
+        const float* row = &components[i * inDim];
+        float sum = 0.0f;
+        for (size_t j = 0; j < inDim; ++j) sum += row[j] * (v[j] - mean[j]);
+        out[i] = sum;
+    }
+    return out;
+}
+
+bool EmbeddingProjection::empty() const
+{
+    return outDim == 0;
+}
+
+size_t EmbeddingProjection::inputDim() const
+{
+    return inDim;
+}
+
+size_t EmbeddingProjection::outputDim() const
+{
+    return outDim;
+}
+
+const std::vector<float>& EmbeddingProjection::getMean() const
+{
+    return mean;
+}
+
+const std::vector<float>& EmbeddingProjection::getComponents() const
+{
+    return components;
+}
+
+double EmbeddingProjection::getExplainedVariance() const
+{
+    return explainedVariance;
+}
+
+// Parses "[1,2,3]" or "{1,2,3}" into floats
+std::vector<float> parseFloatList(std::string_view text)
+{
+    std::vector<float> out;
+    const char* p = text.data();
+    const char* end = p + text.size();
+
+    while (p < end) {
+        if (*p == '[' || *p == ']' || *p == '{' || *p == '}' || *p == ',' || *p == ' ') {
+            ++p;
+            continue;
+        }
+        float value = 0.0f;
+        auto [next, ec] = std::from_chars(p, end, value);
+        if (ec != std::errc()) break;
+        out.push_back(value);
+        p = next;
+    }
+    return out;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+/*
+This class holds a linear projection from full embeddings to a reduced dimension.
+The projection is learned with PCA from a sample of stored embeddings, so no model retraining is needed.
+Projected vectors are mean centered, cosine distance on them approximates cosine distance on the originals.
+*/
+
+class EmbeddingProjection {
+public:
+    EmbeddingProjection() = default;
+    EmbeddingProjection(
+        size_t inDim,
+        size_t outDim,
+        std::vector<float> mean,
+        std::vector<float> components
+    );
+
+    // Learn the top outDim principal components of the samples
+    static EmbeddingProjection learn(
+        const std::vector<std::vector<float>>& samples,
+        size_t outDim
+    );
+
+    std::vector<float> project(const std::vector<float>& v) const;
+    std::vector<float> project(const float* v, size_t n) const;     // n must equal inputDim(), e.g. a row of an EmbeddingMatrix
+
+    bool empty() const;
+    size_t inputDim() const;
+    size_t outputDim() const;
+    const std::vector<float>& getMean() const;
+    const std::vector<float>& getComponents() const;
+
+    double getExplainedVariance() const;    // share of sample variance kept, only set by learn()
+
+private:
+    size_t inDim = 0;
+    size_t outDim = 0;
+    std::vector<float> mean;                // inDim
+    std::vector<float> components;          // outDim x inDim, row major
+    double explainedVariance = 0.0;
+};
+
+// Parses a pgvector "[1,2,3]" or Postgres array "{1,2,3}" literal into floats
+std::vector<float> parseFloatList(std::string_view text);
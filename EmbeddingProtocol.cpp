@@ -0,0 +1,83 @@
+#include "EmbeddingProtocol.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Append a u32 to the buffer
+static void writeU32(std::string& out, uint32_t v)
+{
+    char bytes[4];
+    std::memcpy(bytes, &v, sizeof(v));
+    out.append(bytes, sizeof(bytes));
+}
+
+// Read a u32 at pos, advancing pos, returns false if out of bounds
+static bool readU32(std::string_view in, size_t& pos, uint32_t& v)
+{
+    if (pos > in.size() || in.size() - pos < sizeof(v)) return false;
+    std::memcpy(&v, in.data() + pos, sizeof(v));
+    pos += sizeof(v);
+    return true;
+}
+
+std::string encodeEmbedRequest(const std::vector<std::string_view>& texts)
+{
+    size_t bytes = sizeof(uint32_t);
+    for (const auto& t : texts) bytes += sizeof(uint32_t) + t.size();
+
+    std::string out;
+    out.reserve(bytes);
+    writeU32(out, static_cast<uint32_t>(texts.size()));
+    for (const auto& t : texts) {
+        writeU32(out, static_cast<uint32_t>(t.size()));
+        out.append(t);
+    }
+    return out;
+}
+
+bool decodeEmbedRequest(std::string_view body, std::vector<std::string_view>& texts)
+{
+    size_t pos = 0;
+    uint32_t count;
+    if (!readU32(body, pos, count)) return false;
+
+	// count comes from the peer, every text takes at least its length prefix so the body bounds the reservation
+    texts.clear();
+    texts.reserve(std::min<size_t>(count, (body.size() - pos) / sizeof(uint32_t)));
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t len;
+        if (!readU32(body, pos, len) || body.size() - pos < len) return false;
+        texts.push_back(body.substr(pos, len));
+        pos += len;
+    }
+    return pos == body.size();
+}
+
+std::string encodeEmbedResponse(const EmbeddingMatrix& embeddings)
+{
+    uint32_t count = static_cast<uint32_t>(embeddings.rows());
+    uint32_t dim = static_cast<uint32_t>(embeddings.dim);
+
+    std::string out;
+    out.reserve(2 * sizeof(uint32_t) + static_cast<size_t>(count) * dim * sizeof(float));
+    writeU32(out, count);
+    writeU32(out, dim);
+    out.append(reinterpret_cast<const char*>(embeddings.values.data()), embeddings.values.size() * sizeof(float));
+    return out;
+}
+
+bool decodeEmbedResponse(std::string_view body, size_t count, EmbeddingMatrix& out, size_t firstRow)
+{
+    size_t pos = 0;
+    uint32_t bodyCount, dim;
+    if (!readU32(body, pos, bodyCount) || !readU32(body, pos, dim)) return false;
+    if (bodyCount != count || dim != out.dim || firstRow + count > out.rows()) return false;
+    if (body.size() - pos != count * dim * sizeof(float)) return false;
+
+    std::memcpy(out.row(firstRow), body.data() + pos, count * dim * sizeof(float));
+    return true;
+}
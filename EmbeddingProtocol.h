@@ -0,0 +1,27 @@
+#pragma once
+#include "EmbeddingMatrix.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+Binary protocol between the ingest process and embedding workers, sent over HTTP POST /embed.
+All integers and floats are little-endian.
+
+Request:  u32 count, then count x (u32 length, length bytes of UTF-8 text)
+Response: u32 count, u32 dim, then count x dim float32 values
+*/
+
+constexpr const char* EMBED_PATH = "/embed";
+constexpr const char* EMBED_CONTENT_TYPE = "application/octet-stream";
+
+std::string encodeEmbedRequest(const std::vector<std::string_view>& texts);
+
+// Texts are views into body, returns false if the body is truncated or malformed
+bool decodeEmbedRequest(std::string_view body, std::vector<std::string_view>& texts);
+
+std::string encodeEmbedResponse(const EmbeddingMatrix& embeddings);
+
+// Decodes straight into rows firstRow.. of out, returns false if the body is malformed or its shape isn't count x out.dim
+bool decodeEmbedResponse(std::string_view body, size_t count, EmbeddingMatrix& out, size_t firstRow);
@@ -0,0 +1,60 @@
+#include "EmbeddingWorker.h"
+#include "EmbeddingProtocol.h"
+#include "ONNXEmbedder.h"
+
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <httplib.h>
+
+// Constructor, loads the model and registers routes
+EmbeddingWorker::EmbeddingWorker(
+    const std::string& modelPath,
+    const std::string& vocabPath,
+    size_t maxLen)
+    : embedder(std::make_unique<ONNXEmbedder>(modelPath, vocabPath, maxLen))
+{
+	// httplib defaults to a thread per core, those threads only decode requests and wait on the embedder
+    server.new_task_queue = [] { return new httplib::ThreadPool(WORKER_HTTP_THREADS); };
+
+    server.Post(EMBED_PATH, [this](const httplib::Request& req, httplib::Response& res) {
+        handleEmbed(req, res);
+    });
+
+    server.Get("/health", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content("ok", "text/plain");
+    });
+}
+
+bool EmbeddingWorker::listen(const std::string& host, int port)
+{
+    std::cout << "Embedding worker listening on " << host << ":" << port << std::endl;
+    return server.listen(host, port);
+}
+
+void EmbeddingWorker::stop()
+{
+    server.stop();
+}
+
+// Decode texts, embed them and send back the raw float matrix
+void EmbeddingWorker::handleEmbed(const httplib::Request& req, httplib::Response& res)
+{
+    std::vector<std::string_view> texts;   // views into the request body
+    if (!decodeEmbedRequest(req.body, texts)) {
+        res.status = 400;
+        res.set_content("malformed embed request", "text/plain");
+        return;
+    }
+
+    try {
+        res.set_content(encodeEmbedResponse(embedder->embedBatch(texts)), EMBED_CONTENT_TYPE);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Embedding failed: " << e.what() << "\n";
+        res.status = 500;
+        res.set_content(e.what(), "text/plain");
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "ONNXEmbedder.h"
+
+#include <memory>
+#include <string>
+#include <httplib.h>
+
+/*
+This class runs a standalone embedding worker, exposing ONNXEmbedder over HTTP with the binary protocol in EmbeddingProtocol.h.
+Started with: EngineDB --embed-worker <port>
+*/
+
+constexpr size_t WORKER_HTTP_THREADS = 2;   // request threads, inference itself runs on the ORT global pool
+
+class EmbeddingWorker {
+public:
+    EmbeddingWorker(
+        const std::string& modelPath,
+        const std::string& vocabPath,
+        size_t maxLen
+    );
+
+    // Blocks serving requests until stop() is called
+    bool listen(const std::string& host, int port);
+    void stop();
+
+private:
+    std::unique_ptr<ONNXEmbedder> embedder;
+    httplib::Server server;
+
+    void handleEmbed(const httplib::Request& req, httplib::Response& res);
+};
@@ -0,0 +1,424 @@
+#include "FlatIndex.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The SIMD kernels are compiled for every x86-64 build and picked at runtime from cpuid, see flatKernels
+// GCC and Clang need the instruction sets enabled per function, MSVC allows the intrinsics anywhere
+#if defined(__x86_64__) || defined(_M_X64)
+#define FLAT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define FLAT_TARGET(isa)
+#else
+#define FLAT_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+constexpr char FLAT_MAGIC[8] = { 'E', 'D', 'B', 'F', 'L', 'A', 'T', '\0' };
+constexpr uint32_t FLAT_VERSION = 1;
+constexpr size_t FLAT_HEADER_BYTES = 64;    // matrix starts cache line aligned
+constexpr size_t FLAT_BLOCK_ROWS = 8192;    // rows scanned per thread pool task
+
+// IEEE half to float
+static float halfToFloat(uint16_t h)
+{
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        }
+        else {
+            // subnormal, renormalize
+            exp = 127 - 15 + 1;
+            while (!(mant & 0x400)) {
+                mant <<= 1;
+                --exp;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+        }
+    }
+    else if (exp == 0x1f) {
+        bits = sign | 0x7f800000 | (mant << 13);
+    }
+    else {
+        bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Float to IEEE half, round to nearest even, embeddings never get near the fp16 range limits
+static uint16_t floatToHalf(float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    int32_t exp = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = bits & 0x7fffff;
+
+    if (exp >= 0x1f) return sign | 0x7c00;     // overflow to infinity
+    if (exp <= 0) {
+        if (exp < -10) return sign;             // underflow to zero
+        mant |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - exp);
+        uint32_t half = mant >> shift;
+        uint32_t rest = mant & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = (static_cast<uint32_t>(exp) << 10) | (mant >> 13);
+    uint32_t rest = mant & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) ++half;   // may carry into the exponent, which is correct
+    return static_cast<uint16_t>(sign | half);
+}
+
+static float dotF32Scalar(const float* a, const float* b, size_t n)
+{
+    size_t i = 0;
+    float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (; i + 4 <= n; i += 4) {
+        for (size_t j = 0; j < 4; ++j) acc[j] += a[i + j] * b[i + j];
+    }
+    float sum = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+static float dotF16Scalar(const float* q, const uint16_t* row, size_t n)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) sum += q[i] * halfToFloat(row[i]);
+    return sum;
+}
+
+#ifdef FLAT_X86
+FLAT_TARGET("avx2")
+static float horizontalSum(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+FLAT_TARGET("avx2,fma")
+static float dotF32Avx2(const float* a, const float* b, size_t n)
+{
+    size_t i = 0;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    float sum = horizontalSum(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+FLAT_TARGET("avx2,fma,f16c")
+static float dotF16Avx2(const float* q, const uint16_t* row, size_t n)
+{
+    size_t i = 0;
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m256 r = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(q + i), r, acc);
+    }
+    float sum = horizontalSum(acc);
+    for (; i < n; ++i) sum += q[i] * halfToFloat(row[i]);
+    return sum;
+}
+
+FLAT_TARGET("avx512f")
+static float dotF32Avx512(const float* a, const float* b, size_t n)
+{
+    size_t i = 0;
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    }
+    float sum = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+FLAT_TARGET("avx512f")
+static float dotF16Avx512(const float* q, const uint16_t* row, size_t n)
+{
+    size_t i = 0;
+    __m512 acc = _mm512_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        __m512 r = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i)));
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(q + i), r, acc);
+    }
+    float sum = _mm512_reduce_add_ps(acc);
+    for (; i < n; ++i) sum += q[i] * halfToFloat(row[i]);
+    return sum;
+}
+
+// CPU and OS support, the OS has to save the wider registers on context switches (XCR0)
+static void detectSimd(bool& avx2, bool& avx512)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool f16c = (info[2] & (1 << 29)) != 0;
+    if (!osxsave || !avx || maxLeaf < 7) return;
+
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    avx2 = (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) && fma && f16c;
+    avx512 = (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16));
+#else
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+    avx512 = __builtin_cpu_supports("avx512f");
+#endif
+}
+#endif
+
+// Dot product kernels for the CPU the process runs on
+struct FlatKernels {
+    float (*dotF32)(const float*, const float*, size_t);
+    float (*dotF16)(const float*, const uint16_t*, size_t);
+    const char* name;
+};
+
+static const FlatKernels& flatKernels()
+{
+    static const FlatKernels kernels = [] {
+        FlatKernels k{ dotF32Scalar, dotF16Scalar, "scalar" };
+#ifdef FLAT_X86
+        bool avx2 = false, avx512 = false;
+        detectSimd(avx2, avx512);
+        if (avx512) k = { dotF32Avx512, dotF16Avx512, "AVX-512" };
+        else if (avx2) k = { dotF32Avx2, dotF16Avx2, "AVX2" };
+#endif
+        return k;
+    }();
+    return kernels;
+}
+
+static size_t elementBytes(FlatElement element)
+{
+    return element == FlatElement::Float16 ? sizeof(uint16_t) : sizeof(float);
+}
+
+// Constructor, rows are appended as they are added
+FlatIndexWriter::FlatIndexWriter(const std::string& path, size_t dim, FlatElement element)
+    : out(path, std::ios::binary | std::ios::trunc), path(path), dim(dim), element(element)
+{
+    if (!out) throw std::runtime_error("Could not create flat index " + path);
+    writeHeader(0);
+}
+
+void FlatIndexWriter::add(int64_t id, const std::vector<float>& v)
+{
+    if (finished) throw std::logic_error("Flat index is already finished");
+    if (v.size() != dim) throw std::invalid_argument("Vector dimension does not match the flat index");
+
+    double norm = 0.0;
+    for (float x : v) norm += static_cast<double>(x) * x;
+    float scale = norm > 0.0 ? static_cast<float>(1.0 / std::sqrt(norm)) : 0.0f;
+
+    if (element == FlatElement::Float16) {
+        std::vector<uint16_t> row(dim);
+        for (size_t i = 0; i < dim; ++i) row[i] = floatToHalf(v[i] * scale);
+        out.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(uint16_t));
+    }
+    else {
+        std::vector<float> row(dim);
+        for (size_t i = 0; i < dim; ++i) row[i] = v[i] * scale;
+        out.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+    ids.push_back(id);
+}
+
+void FlatIndexWriter::finish()
+{
+    if (finished) return;
+    finished = true;
+
+    uint64_t idsOffset = static_cast<uint64_t>(out.tellp());
+    out.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(int64_t));
+    out.seekp(0);
+    writeHeader(idsOffset);
+    out.close();
+    if (!out) throw std::runtime_error("Could not write flat index " + path);
+}
+
+size_t FlatIndexWriter::size() const
+{
+    return ids.size();
+}
+
+void FlatIndexWriter::writeHeader(uint64_t idsOffset)
+{
+    char header[FLAT_HEADER_BYTES] = {};
+    uint32_t version = FLAT_VERSION;
+    uint32_t dim32 = static_cast<uint32_t>(dim);
+    uint32_t type = static_cast<uint32_t>(element);
+    uint64_t rows = ids.size();
+
+    std::memcpy(header, FLAT_MAGIC, sizeof(FLAT_MAGIC));
+    std::memcpy(header + 8, &version, sizeof(version));
+    std::memcpy(header + 12, &dim32, sizeof(dim32));
+    std::memcpy(header + 16, &type, sizeof(type));
+    std::memcpy(header + 24, &rows, sizeof(rows));
+    std::memcpy(header + 32, &idsOffset, sizeof(idsOffset));
+    out.write(header, sizeof(header));
+}
+
+// Constructor, maps the file and checks its layout
+FlatIndex::FlatIndex(const std::string& path)
+    : file(path, MapAdvice::WillNeed)
+{
+    const char* data = file.data();
+    if (file.size() < FLAT_HEADER_BYTES || std::memcmp(data, FLAT_MAGIC, sizeof(FLAT_MAGIC)) != 0) {
+        throw std::runtime_error("Not a flat index: " + path);
+    }
+
+    uint32_t version, dim32, type;
+    uint64_t rowCount, idsOffset;
+    std::memcpy(&version, data + 8, sizeof(version));
+    std::memcpy(&dim32, data + 12, sizeof(dim32));
+    std::memcpy(&type, data + 16, sizeof(type));
+    std::memcpy(&rowCount, data + 24, sizeof(rowCount));
+    std::memcpy(&idsOffset, data + 32, sizeof(idsOffset));
+
+    if (version != FLAT_VERSION || type > static_cast<uint32_t>(FlatElement::Float16) || dim32 == 0) {
+        throw std::runtime_error("Unsupported flat index " + path);
+    }
+
+    rows = rowCount;
+    dimension = dim32;
+    elementType = static_cast<FlatElement>(type);
+
+	// Bound the row count by the file size before multiplying, a corrupt header could overflow the sizes
+    uint64_t rowBytes = static_cast<uint64_t>(dimension) * elementBytes(elementType);
+    if (rowCount > (file.size() - FLAT_HEADER_BYTES) / (rowBytes + sizeof(int64_t))) {
+        throw std::runtime_error("Flat index is truncated or was not finished: " + path);
+    }
+    uint64_t matrixBytes = rowCount * rowBytes;
+    if (idsOffset != FLAT_HEADER_BYTES + matrixBytes || file.size() - idsOffset < rowCount * sizeof(int64_t)) {
+        throw std::runtime_error("Flat index is truncated or was not finished: " + path);
+    }
+
+    matrix = data + FLAT_HEADER_BYTES;
+    ids = data + idsOffset;
+}
+
+std::vector<FlatHit> FlatIndex::search(const std::vector<float>& query, size_t k) const
+{
+    TRACE_SCOPE("FlatIndex::search");
+    if (query.size() != dimension || rows == 0 || k == 0) return {};
+    k = std::min(k, rows);
+
+    double norm = 0.0;
+    for (float x : query) norm += static_cast<double>(x) * x;
+    if (norm <= 0.0) return {};
+    std::vector<float> q(query);
+    for (auto& x : q) x = static_cast<float>(x / std::sqrt(norm));
+
+	// Hits hold row numbers until the merge, ids are only read for the winners
+    struct Hit {
+        float score;
+        size_t row;
+    };
+    auto better = [](const Hit& a, const Hit& b) {
+        return a.score > b.score || (a.score == b.score && a.row < b.row);
+    };
+
+    const FlatKernels& kernels = flatKernels();
+    size_t blocks = (rows + FLAT_BLOCK_ROWS - 1) / FLAT_BLOCK_ROWS;
+    std::vector<std::vector<Hit>> heaps(blocks);
+    size_t rowBytes = dimension * elementBytes(elementType);
+
+    ThreadPool::shared().parallelFor(0, blocks, 1, [&](size_t b) {
+        std::vector<Hit>& heap = heaps[b];      // min-heap on score, front is the worst kept hit
+        heap.reserve(k);
+
+        size_t end = std::min(rows, (b + 1) * FLAT_BLOCK_ROWS);
+        for (size_t r = b * FLAT_BLOCK_ROWS; r < end; ++r) {
+            const char* row = matrix + r * rowBytes;
+            float score = elementType == FlatElement::Float16
+                ? kernels.dotF16(q.data(), reinterpret_cast<const uint16_t*>(row), dimension)
+                : kernels.dotF32(q.data(), reinterpret_cast<const float*>(row), dimension);
+
+            if (heap.size() < k) {
+                heap.push_back({ score, r });
+                std::push_heap(heap.begin(), heap.end(), better);
+            }
+            else if (better({ score, r }, heap.front())) {
+                std::pop_heap(heap.begin(), heap.end(), better);
+                heap.back() = { score, r };
+                std::push_heap(heap.begin(), heap.end(), better);
+            }
+        }
+    });
+
+	// Merge the per-block heaps
+    std::vector<Hit> all;
+    all.reserve(blocks * k);
+    for (const auto& heap : heaps) all.insert(all.end(), heap.begin(), heap.end());
+    std::partial_sort(all.begin(), all.begin() + k, all.end(), better);
+
+    std::vector<FlatHit> hits(k);
+    for (size_t i = 0; i < k; ++i) {
+        std::memcpy(&hits[i].id, ids + all[i].row * sizeof(int64_t), sizeof(int64_t));
+        hits[i].score = all[i].score;
+    }
+    return hits;
+}
+
+size_t FlatIndex::size() const
+{
+    return rows;
+}
+
+size_t FlatIndex::dim() const
+{
+    return dimension;
+}
+
+FlatElement FlatIndex::element() const
+{
+    return elementType;
+}
+
+const char* FlatIndex::kernelName()
+{
+    return flatKernels().name;
+}
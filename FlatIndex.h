@@ -0,0 +1,78 @@
+#pragma once
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+Exact nearest-neighbour search over a memory-mapped matrix of exported embeddings.
+Rows are unit length so cosine similarity is a dot product, scanned with AVX-512 or AVX2 + FMA when the CPU has them
+and a scalar loop otherwise, the kernel is picked at runtime so one binary runs on any x86-64 CPU. The scan is split into blocks on ThreadPool::shared(), each block keeps its own top-k
+heap and the heaps are merged at the end, so recall is exact and latency only depends on the row count.
+An export is a snapshot, rows ingested afterwards are not in it until the next export.
+
+Layout, integers in host byte order:
+    header  "EDBFLAT\0", u32 version, u32 dim, u32 element type, u32 reserved, u64 rows, u64 ids offset, padded to 64 bytes
+    matrix  rows x dim fp32 or fp16 values
+    ids     rows x i64 article ids
+*/
+
+enum class FlatElement : uint32_t {
+    Float32 = 0,
+    Float16 = 1,    // half the memory and bandwidth, scores differ from fp32 in the 3rd-4th decimal
+};
+
+// Holds one flat scan result, score is cosine similarity
+struct FlatHit {
+    int64_t id;
+    float score;
+};
+
+class FlatIndexWriter {
+public:
+    FlatIndexWriter(
+        const std::string& path,
+        size_t dim,
+        FlatElement element
+    );
+
+    void add(int64_t id, const std::vector<float>& v);     // v is normalized before it is stored
+    void finish();
+
+    size_t size() const;
+
+private:
+    void writeHeader(uint64_t idsOffset);
+
+    std::ofstream out;
+    std::string path;
+    size_t dim;
+    FlatElement element;
+    std::vector<int64_t> ids;   // written after the matrix
+    bool finished = false;
+};
+
+class FlatIndex {
+public:
+    explicit FlatIndex(const std::string& path);   // throws std::runtime_error on a malformed file
+
+    // Exact top k rows by cosine similarity, best first
+    std::vector<FlatHit> search(const std::vector<float>& query, size_t k) const;
+
+    size_t size() const;
+    size_t dim() const;
+    FlatElement element() const;
+
+    static const char* kernelName();    // SIMD kernel picked for this CPU
+
+private:
+    MappedFile file;
+    size_t rows = 0;
+    size_t dimension = 0;
+    FlatElement elementType = FlatElement::Float32;
+    const char* matrix = nullptr;
+    const char* ids = nullptr;
+};
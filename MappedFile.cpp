@@ -0,0 +1,115 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Map the whole file read-only
+MappedFile::MappedFile(const std::string& path, MapAdvice advice)
+{
+#ifdef _WIN32
+    DWORD accessFlag = advice == MapAdvice::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | accessFlag, nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Could not open " + path);
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error("Could not stat " + path);
+    }
+    fileHandle = file;
+    length = static_cast<size_t>(size.QuadPart);
+    if (length == 0) return;
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        close();
+        throw std::runtime_error("Could not map " + path);
+    }
+    mappingHandle = mapping;
+
+    ptr = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!ptr) {
+        close();
+        throw std::runtime_error("Could not map " + path);
+    }
+    if (advice == MapAdvice::WillNeed) {
+        WIN32_MEMORY_RANGE_ENTRY range{ const_cast<char*>(ptr), length };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);   // best effort
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Could not open " + path);
+
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat " + path);
+    }
+    length = static_cast<size_t>(st.st_size);
+
+    if (length > 0) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Could not map " + path);
+        }
+        int flag = advice == MapAdvice::Sequential ? MADV_SEQUENTIAL
+            : advice == MapAdvice::Random ? MADV_RANDOM
+            : MADV_WILLNEED;
+        madvise(p, length, flag);
+        ptr = static_cast<const char*>(p);
+    }
+    ::close(fd);    // the mapping stays valid after the descriptor is closed
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other) {
+        close();
+        ptr = std::exchange(other.ptr, nullptr);
+        length = std::exchange(other.length, 0);
+#ifdef _WIN32
+        fileHandle = std::exchange(other.fileHandle, nullptr);
+        mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (ptr) UnmapViewOfFile(ptr);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (ptr) munmap(const_cast<char*>(ptr), length);
+#endif
+    ptr = nullptr;
+    length = 0;
+}
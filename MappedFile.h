@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/*
+This class maps a file read-only into memory, used for zero-copy reading of binary corpus, vector and vocab files.
+*/
+
+// How the mapping will be read, passed to the OS as paging advice
+enum class MapAdvice {
+    Sequential,     // read once front to back, pages can be dropped right after (corpus and JSON scans)
+    Random,         // probed at random, no read-ahead (vocab hash table)
+    WillNeed        // read over and over, prefetched and kept resident (flat index)
+};
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const std::string& path, MapAdvice advice);  // throws std::runtime_error if the file can't be mapped
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+    std::string_view view() const { return { ptr, length }; }
+
+private:
+    void close();
+
+    const char* ptr = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
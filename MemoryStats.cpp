@@ -0,0 +1,56 @@
+#include "MemoryStats.h"
+
+#include <cstddef>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <fstream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Clean pages of mapped corpus, JSON and flat index files are dropped by the OS under pressure, so they are left out
+size_t anonymousMemoryBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS_EX counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters))) {
+        return static_cast<size_t>(counters.PrivateUsage);
+    }
+    return 0;
+#else
+	// statm fields are total, resident and resident file-backed pages
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0, shared = 0;
+    if (statm >> pages >> resident >> shared) {
+        return (resident > shared ? resident - shared : 0) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+#endif
+}
+
+size_t peakResidentMemoryBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<size_t>(counters.PeakWorkingSetSize);
+    }
+    return 0;
+#else
+    struct rusage usage {};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);           // bytes on macOS
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;    // kilobytes on Linux
+#endif
+    }
+    return 0;
+#endif
+}
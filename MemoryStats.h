@@ -0,0 +1,10 @@
+#pragma once
+#include <cstddef>
+
+/*
+Process memory readings used to size ingest batches and report peak usage.
+Both return 0 on platforms where they are not available.
+*/
+
+size_t anonymousMemoryBytes();      // current resident heap and stack, mapped files don't count
+size_t peakResidentMemoryBytes();   // peak resident set size since process start
@@ -1,15 +1,23 @@
 ﻿#include "ONNXEmbedder.h"
+#include "CpuBudget.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
 #include <cmath>
+#include <filesystem>
+#include <iostream>
 #include <numeric>
+#include <stdexcept>
 #include <vector>
 #include <utility>
 #include <string>
 #include <cstdint>
 #include <array>
-#include <thread>
 #include "packages/Microsoft.ML.OnnxRuntime.1.23.2/build/native/include/onnxruntime_c_api.h"
 #include "packages/Microsoft.ML.OnnxRuntime.1.23.2/build/native/include/onnxruntime_cxx_api.h"
 
+namespace fs = std::filesystem;
+
 // Convert std::string to ORTCHAR_T*, needed for Windows compatibility
 #ifdef _WIN32
 inline static const ORTCHAR_T* ToOrtString(const std::string& s) {
@@ -28,38 +36,91 @@ ONNXEmbedder::ONNXEmbedder(
     const std::string& modelPath,
     const std::string& vocabPath,
     size_t maxLen)
-    : env(ORT_LOGGING_LEVEL_WARNING, "ONNXEmbedder"),
-    sessionOptions(),
+    : sessionOptions(),
     session(nullptr),
     tokenizer(vocabPath),
     maxLen(maxLen)
 {
-    sessionOptions.SetIntraOpNumThreads(std::thread::hardware_concurrency());
+    TRACE_SCOPE("ONNXEmbedder::load");
+    sessionOptions.DisablePerSessionThreads();
+
+	// Reuse the graph optimized on an earlier start, it's only rebuilt when the model file is newer
+    std::string cachedPath = fs::path(modelPath).replace_extension(".optimized.ort").string();
+    std::error_code ec;
+    if (fs::exists(cachedPath, ec) && fs::last_write_time(cachedPath, ec) >= fs::last_write_time(modelPath, ec)) {
+        try {
+            sessionOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+            session = Ort::Session(
+                sharedEnv(),
+                ToOrtString(cachedPath),
+                sessionOptions);
+            return;
+        }
+        catch (const Ort::Exception& e) {
+            std::cerr << "Ignoring optimized model " << cachedPath << ": " << e.what() << std::endl;
+        }
+    }
+
+	// Optimize from scratch and serialize the result for the next start
     sessionOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+    sessionOptions.SetOptimizedModelFilePath(ToOrtString(cachedPath));
     session = Ort::Session(
-        env,
+        sharedEnv(),
         ToOrtString(modelPath),
         sessionOptions);
 }
 
+// Created on first use, so CpuBudget must be configured before the first embedder
+Ort::Env& ONNXEmbedder::sharedEnv()
+{
+    static Ort::Env env = [] {
+        size_t threads = CpuBudget::inferenceCores();      // the rest of the budget is ThreadPool::shared()
+
+        Ort::ThreadingOptions options;
+        options.SetGlobalIntraOpNumThreads(static_cast<int>(threads));
+        options.SetGlobalInterOpNumThreads(1);
+        options.SetGlobalSpinControl(0);    // idle intra-op threads sleep instead of spinning on budget cores
+        if (CpuBudget::pinThreads() && threads > 1) {
+            std::string affinity = CpuBudget::onnxAffinity(threads);
+            Ort::ThrowOnError(Ort::GetApi().SetGlobalIntraOpThreadAffinity(options, affinity.c_str()));
+        }
+        return Ort::Env(options, ORT_LOGGING_LEVEL_WARNING, "ONNXEmbedder");
+    }();
+    return env;
+}
+
 // Embed a batch of texts
-std::vector<std::vector<float>> ONNXEmbedder::embedBatch(const std::vector<std::string>& texts) {
+EmbeddingMatrix ONNXEmbedder::embedBatch(const std::vector<std::string_view>& texts) {
+    EmbeddingMatrix result(texts.size(), 0);
+    embedBatch(texts, result, 0);
+    return result;
+}
+
+// Embed a batch of texts into rows of a caller owned matrix
+void ONNXEmbedder::embedBatch(const std::vector<std::string_view>& texts, EmbeddingMatrix& out, size_t firstRow) {
+    TRACE_SCOPE("ONNXEmbedder::embedBatch");
     size_t B = texts.size();
-    if (B == 0) return {};
+    if (B == 0) return;
+    if (firstRow + B > out.rows()) {
+        throw std::out_of_range("Embedding rows out of range");
+    }
 
     std::vector<int64_t> flat_ids(B * maxLen);
     std::vector<int64_t> flat_mask(B * maxLen);
     std::vector<int64_t> flat_types(B * maxLen, 0);
 
 	// Tokenize each text
-    for (size_t i = 0; i < B; ++i) {
-        auto encoded = tokenizer.encode(texts[i], maxLen);
-
-        for (size_t j = 0; j < maxLen; ++j) {
-            int64_t id = encoded[j];
-            flat_ids[i * maxLen + j] = id;
-            flat_mask[i * maxLen + j] = (id != tokenizer.pad_id);
-        }
+    {
+        TRACE_SCOPE("ONNXEmbedder::tokenize");
+        ThreadPool::shared().parallelFor(0, B, 4, [&](size_t i) {
+            auto encoded = tokenizer.encode(texts[i], maxLen);
+
+            for (size_t j = 0; j < maxLen; ++j) {
+                int64_t id = encoded[j];
+                flat_ids[i * maxLen + j] = id;
+                flat_mask[i * maxLen + j] = (id != tokenizer.pad_id);
+            }
+        });
     }
 
 	// Create input tensors
@@ -97,32 +158,42 @@ std::vector<std::vector<float>> ONNXEmbedder::embedBatch(const std::vector<std::
     };
 
 	// Execute the model
-    auto outputs = session.Run(
-        Ort::RunOptions{ nullptr },
-        inputNames,
-        inputTensors,
-        3,
-        outputNames,
-        1
-    );
+    std::vector<Ort::Value> outputs;
+    {
+        TRACE_SCOPE("ONNXEmbedder::session.Run");
+        outputs = session.Run(
+            Ort::RunOptions{ nullptr },
+            inputNames,
+            inputTensors,
+            3,
+            outputNames,
+            1
+        );
+    }
 
 	// Process output tensor
-    auto& out = outputs[0];
-    auto info = out.GetTensorTypeAndShapeInfo();
+    auto& output = outputs[0];
+    auto info = output.GetTensorTypeAndShapeInfo();
     auto outShape = info.GetShape();
 
-    int64_t hidden = outShape.back();
-    float* data = out.GetTensorMutableData<float>();
+    size_t hidden = static_cast<size_t>(outShape.back());
+    float* data = output.GetTensorMutableData<float>();
 
-	// Prepare result vector
-    std::vector<std::vector<float>> result(
-        B, std::vector<float>(hidden)
-    );
+	// Size an empty matrix from the model output
+    if (out.dim == 0 && out.values.empty()) {
+        out.dim = hidden;
+        out.values.assign(out.rows() * out.dim, 0.0f);
+    }
+    if (out.dim != hidden) {
+        throw std::runtime_error("Model output dimension does not match the embedding matrix");
+    }
 
-	// Compute mean pooling, ignoring padding tokens
+	// Compute mean pooling straight into the output rows, ignoring padding tokens
+    TRACE_SCOPE("ONNXEmbedder::pooling");
     for (size_t i = 0; i < B; ++i) {
         float* start = data + i * maxLen * hidden;
-        std::vector<float> sum(hidden, 0.0f);
+        float* sum = out.row(firstRow + i);
+        std::fill(sum, sum + hidden, 0.0f);
         int count = 0;
         for (size_t j = 0; j < maxLen; ++j) {
             int64_t id = flat_ids[i * maxLen + j];
@@ -133,27 +204,25 @@ std::vector<std::vector<float>> ONNXEmbedder::embedBatch(const std::vector<std::
                 count++;
             }
         }
-        for (auto& x : sum) x /= count;
-        normalize(sum);
-        result[i] = std::move(sum);
+        for (size_t k = 0; k < hidden; ++k) sum[k] /= count;
+        normalize(sum, hidden);
+        out.valid[firstRow + i] = 1;
     }
-
-    return result;
 }
 
 // Normalize a vector to unit length
-void ONNXEmbedder::normalize(std::vector<float>& v) {
+void ONNXEmbedder::normalize(float* v, size_t n) {
     float norm = std::sqrt(
         std::accumulate(
-            v.begin(), v.end(), 0.0f,
+            v, v + n, 0.0f,
             [](float sum, float val) {
                 return sum + val * val;
             }
         )
     );
     if (norm > 0.0f) {
-        for (auto& x : v) {
-            x /= norm;
+        for (size_t i = 0; i < n; ++i) {
+            v[i] /= norm;
         }
     }
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #pragma once
 #include <onnxruntime_cxx_api.h>
+#include "EmbeddingMatrix.h"
 #include "WordPieceTokenizer.h"
 
 #include <vector>
 #include <string>
+#include <string_view>
 
 /*
 This class is responsible for embedding text using an ONNX model
@@ -11,14 +13,16 @@ This class is responsible for embedding text using an ONNX model
 
 class ONNXEmbedder {
 private:
-	Ort::Env env;                           // ONNX Runtime environment
 	Ort::SessionOptions sessionOptions;     // Session options
 	Ort::Session session;                   // ONNX Runtime session
 
 	WordPieceTokenizer tokenizer;           // Tokenizer instance
 	size_t maxLen;                          // Maximum sequence length
 
-	void normalize(std::vector<float>& v);  // Normalize a vector to unit length
+	void normalize(float* v, size_t n);    // Normalize a vector to unit length
+
+	// Process-wide environment, all sessions share its global thread pools sized from CpuBudget
+	static Ort::Env& sharedEnv();
 
 public:
     ONNXEmbedder(
@@ -27,8 +31,15 @@ public:
         size_t maxLen = 256
     );
 
-	// Embed a batch of texts
-    std::vector<std::vector<float>>
-        embedBatch(const std::vector<std::string>& texts
+	// Embed a batch of texts, one row per text
+    EmbeddingMatrix embedBatch(
+        const std::vector<std::string_view>& texts
+    );
+
+	// Embed texts straight into rows firstRow.. of out, out.dim must match the model or be 0 on an empty matrix
+    void embedBatch(
+        const std::vector<std::string_view>& texts,
+        EmbeddingMatrix& out,
+        size_t firstRow
     );
 };
\ No newline at end of file
@@ -1,9 +1,43 @@
 #pragma once
-#include <string>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
 
-// Represents a page item with title, text, and link
+constexpr std::string_view WIKI_LINK_PREFIX = "https://en.wikipedia.org/wiki/";    // link of an article is prefix + title
+
+// Holds token hash and frequency for a document, used for token overlap scoring
+struct TokenStat {
+    int64_t hash;
+    int16_t freq;
+};
+
+// Article metadata from the dump, stored as indexed columns for filtered search
+struct ArticleMeta {
+    int32_t ns = 0;                 // namespace, 0 for articles
+    int32_t length = 0;             // wikitext length in characters, before cleaning
+    std::string_view timestamp;     // last revision, ISO 8601, empty when unknown
+    std::string_view categories;    // lowercase category names, newline separated
+};
+
+// Represents a page item with title and text, views into memory owned by the ArticleBatch it belongs to
 struct PageItem {
-    std::string title;
-    std::string text;
-    std::string link;
-};
\ No newline at end of file
+    std::string_view title;
+    std::string_view text;
+    std::string_view tokenStats;    // packed records precomputed by the binary corpus (see decodeTokenStats), computed from text on insert when empty
+    ArticleMeta meta;
+};
+
+// A batch of pages together with the buffers their views point into, moved from the parser into storage
+struct ArticleBatch {
+    std::vector<PageItem> pages;
+    std::vector<std::shared_ptr<const void>> owners;    // text arenas, corpus mappings and decompressed blocks
+    size_t tokens = 0;                                  // estimated tokens, see BatchSizer::estimateTokens
+
+    // Keep owner alive as long as this batch, consecutive pages usually share one
+    void retain(const std::shared_ptr<const void>& owner)
+    {
+        if (owners.empty() || owners.back() != owner) owners.push_back(owner);
+    }
+};
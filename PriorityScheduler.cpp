@@ -0,0 +1,78 @@
+#include "PriorityScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+using Clock = std::chrono::steady_clock;
+
+// Constructor
+PriorityScheduler::PriorityScheduler(double lowCpuShare, std::chrono::milliseconds maxLowWait)
+    : lowCpuShare(std::clamp(lowCpuShare, 0.05, 1.0)), maxLowWait(maxLowWait) {
+}
+
+// Wait until the given priority may run
+PriorityScheduler::Ticket PriorityScheduler::acquire(Priority priority)
+{
+    std::unique_lock lock(mutex);
+
+	// Queries only wait while a starved ingest ticket waits for the running ones to drain
+    if (priority == Priority::High) {
+        changed.wait(lock, [this] { return lowStarved == 0 || lowActive > 0; });
+        highActive++;
+        return Ticket(*this, priority);
+    }
+
+	// Low priority runs alone and only when no query is running
+    auto idle = [this] { return lowActive == 0 && highActive == 0; };
+    if (changed.wait_until(lock, Clock::now() + maxLowWait, idle)) {
+        lowActive++;
+        return Ticket(*this, priority);
+    }
+
+	// Waited too long, hold back new queries until the running ones drain
+    lowStarved++;
+    changed.wait(lock, idle);
+    lowStarved--;
+    lowActive++;
+    changed.notify_all();      // held back queries may run alongside it
+    return Ticket(*this, priority);
+}
+
+void PriorityScheduler::setLowCpuShare(double share)
+{
+    std::lock_guard lock(mutex);
+    lowCpuShare = std::clamp(share, 0.05, 1.0);
+}
+
+// Release the resource, low priority work then sleeps to keep its CPU share
+void PriorityScheduler::release(Priority priority, Clock::duration held)
+{
+    double share;
+    {
+        std::lock_guard lock(mutex);
+        if (priority == Priority::High) highActive--;
+        else lowActive--;
+        share = lowCpuShare;
+    }
+    changed.notify_all();
+
+    if (priority == Priority::Low && share < 1.0) {
+        std::this_thread::sleep_for(std::chrono::duration_cast<Clock::duration>(held * ((1.0 - share) / share)));
+    }
+}
+
+PriorityScheduler::Ticket::Ticket(PriorityScheduler& scheduler, Priority priority)
+    : scheduler(&scheduler), priority(priority), start(Clock::now()) {
+}
+
+PriorityScheduler::Ticket::Ticket(Ticket&& other) noexcept
+    : scheduler(std::exchange(other.scheduler, nullptr)), priority(other.priority), start(other.start) {
+}
+
+PriorityScheduler::Ticket::~Ticket()
+{
+    if (scheduler) scheduler->release(priority, Clock::now() - start);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+/*
+This class arbitrates a shared resource (the embedder) between search and ingest.
+High priority work (queries) is admitted right away, low priority work (ingest) only runs one at a time
+when no query is running, and is throttled afterwards to cap its CPU share.
+Ingest never starts while a query runs. So that steady query traffic can't starve it, low priority work that has
+waited maxLowWait holds back new queries until the running ones finish: ingest waits at most maxLowWait plus one
+query, and a query is delayed at most by the queries already running, never by ingest work.
+*/
+
+enum class Priority {
+    High,   // interactive search
+    Low     // background ingest
+};
+
+class PriorityScheduler {
+public:
+    explicit PriorityScheduler(
+        double lowCpuShare = 1.0,                                       // share of wall time low priority work may use
+        std::chrono::milliseconds maxLowWait = std::chrono::seconds(2)  // starvation bound, new queries are held back after this wait
+    );
+
+    // RAII handle, releases the resource on destruction
+    class Ticket {
+    public:
+        Ticket(PriorityScheduler& scheduler, Priority priority);
+        Ticket(Ticket&& other) noexcept;
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        ~Ticket();
+
+    private:
+        PriorityScheduler* scheduler;
+        Priority priority;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    Ticket acquire(Priority priority);
+
+    void setLowCpuShare(double share);
+
+private:
+    void release(Priority priority, std::chrono::steady_clock::duration held);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    size_t highActive = 0;
+    size_t lowActive = 0;
+    size_t lowStarved = 0;      // low priority waiters past maxLowWait, new high priority work waits for them
+
+    double lowCpuShare;
+    std::chrono::milliseconds maxLowWait;
+};
@@ -0,0 +1,98 @@
+#include "Reranker.h"
+#include "TextUtils.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+
+QueryFeatures::QueryFeatures(std::pmr::memory_resource* arena)
+    : cleanQuery(arena), tokens(arena), hashes(arena) {
+}
+
+void buildQueryFeatures(std::string_view query, QueryFeatures& features)
+{
+    features.cleanQuery.clear();
+    cleanStringInto(query, features.cleanQuery);
+
+    features.tokens.clear();
+    forEachWord(features.cleanQuery, [&features](std::string_view word) {
+        word = stemToken(word);
+        if (!isStopword(word)) features.tokens.push_back(word);
+    });
+
+    std::sort(features.tokens.begin(), features.tokens.end());
+    features.tokens.erase(
+        std::unique(features.tokens.begin(), features.tokens.end()),
+        features.tokens.end());
+
+    features.hashes.clear();
+    for (auto t : features.tokens) features.hashes.push_back(hashToken(t));
+    std::sort(features.hashes.begin(), features.hashes.end());
+}
+
+// Streams over the (hash,freq) tuples, no map is built
+float keywordScore(const QueryFeatures& query, std::string_view tokenStats)
+{
+    if (query.hashes.empty() || tokenStats.empty()) return 0.0f;
+
+    const char* end = tokenStats.data() + tokenStats.size();
+    size_t i = 0;
+    float score = 0.0f;
+
+    while ((i = tokenStats.find('(', i)) != std::string_view::npos) {
+        const char* p = tokenStats.data() + i + 1;
+
+        int64_t hash = 0;
+        auto [afterHash, ec1] = std::from_chars(p, end, hash);
+        if (ec1 != std::errc() || afterHash >= end || *afterHash != ',') break;
+
+        int freq = 0;
+        auto [afterFreq, ec2] = std::from_chars(afterHash + 1, end, freq);
+        if (ec2 != std::errc()) break;
+
+        if (std::binary_search(query.hashes.begin(), query.hashes.end(), hash)) {
+            score += std::log1p(static_cast<float>(freq));
+        }
+        i = static_cast<size_t>(afterFreq - tokenStats.data());
+    }
+
+    return score / static_cast<float>(query.hashes.size());
+}
+
+float titleScore(const QueryFeatures& query, std::string_view cleanTitle)
+{
+    std::string_view cleanQuery = query.cleanQuery;
+    float score = 0.0f;
+
+    if (cleanTitle == cleanQuery)
+        return 2.5f;               // exact match wins immediately
+
+    if (cleanTitle.find(cleanQuery) != std::string_view::npos)
+        score += 1.5f;             // strong partial match
+
+    if (!query.tokens.empty()) {
+        int overlap = 0;
+        for (auto t : query.tokens)
+            overlap += (cleanTitle.find(t) != std::string_view::npos);
+
+        score += static_cast<float>(overlap) /
+            static_cast<float>(query.tokens.size());
+    }
+
+    return score;
+}
+
+float rerankScore(
+    const QueryFeatures& query,
+    const SearchConfig& config,
+    float knnScore,
+    std::string_view cleanTitle,
+    std::string_view tokenStats)
+{
+    return knnScore * config.knnWeight +
+        keywordScore(query, tokenStats) * config.keywordWeight +
+        titleScore(query, cleanTitle) * config.titleWeight;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "VectorStorage.h"
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+Hybrid rerank scoring: embedding similarity, token overlap and title heuristics.
+Query features are computed once per request into an arena, candidates are scored straight from
+the row text without copying or building per-candidate containers.
+*/
+
+// Query side features, computed once per search, memory comes from the request arena
+struct QueryFeatures {
+    explicit QueryFeatures(std::pmr::memory_resource* arena);
+
+    std::pmr::string cleanQuery;                // lowercase, punctuation stripped
+    std::pmr::vector<std::string_view> tokens;  // unique stemmed non-stopword tokens, views into cleanQuery
+    std::pmr::vector<int64_t> hashes;           // token hashes, sorted for binary search
+};
+
+void buildQueryFeatures(std::string_view query, QueryFeatures& features);
+
+// Overlap of query token hashes with a token_stats literal such as {"(123,4)","(-5,6)"}, log scaled by frequency
+float keywordScore(const QueryFeatures& query, std::string_view tokenStats);
+
+// Exact match, partial match and token overlap between the query and a normalized title
+float titleScore(const QueryFeatures& query, std::string_view cleanTitle);
+
+// Final weighted score of one candidate
+float rerankScore(
+    const QueryFeatures& query,
+    const SearchConfig& config,
+    float knnScore,
+    std::string_view cleanTitle,
+    std::string_view tokenStats
+);
@@ -0,0 +1,335 @@
+#include "SearchBenchmark.h"
+#include "AllocationCounter.h"
+#include "Reranker.h"
+#include "TextUtils.h"
+#include "VectorStorage.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Constructor
+SearchBenchmark::SearchBenchmark(VectorStorage& storage, const SearchConfig& config)
+    : storage(storage), config(config) {
+}
+
+// Run the benchmark described by options
+BenchmarkReport SearchBenchmark::run(const BenchmarkOptions& options)
+{
+    std::vector<std::string> queries = loadQueries(options.queryLogPath);
+    if (queries.empty()) {
+        throw std::runtime_error("No queries found in " + options.queryLogPath);
+    }
+
+    BenchmarkReport report;
+
+    RankStats rankBefore = storage.rankStats();
+    auto start = Clock::now();
+    std::vector<double> latencies = options.openLoop
+        ? runOpenLoop(queries, options, report.errors)
+        : runClosedLoop(queries, options, report.errors);
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    RankStats rankAfter = storage.rankStats();
+    if (rankAfter.candidates > rankBefore.candidates) {
+        report.rankAllocationsPerCandidate = static_cast<double>(rankAfter.allocations - rankBefore.allocations)
+            / static_cast<double>(rankAfter.candidates - rankBefore.candidates);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    report.queries = latencies.size();
+    report.qps = report.seconds > 0.0 ? report.queries / report.seconds : 0.0;
+    report.p50 = percentile(latencies, 0.50);
+    report.p95 = percentile(latencies, 0.95);
+    report.p99 = percentile(latencies, 0.99);
+    report.p999 = percentile(latencies, 0.999);
+
+	// Recall is computed after the timed run so exact scans don't skew latencies
+    if (options.computeRecall) {
+        report.recallAtK = recallAtK(queries, options.topK);
+    }
+
+    return report;
+}
+
+// Print report to stdout
+void SearchBenchmark::printReport(const BenchmarkReport& report, const BenchmarkOptions& options)
+{
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Mode: " << (options.openLoop ? "open loop" : "closed loop")
+        << (options.paged ? ", paged" : "")
+        << ", concurrency: " << options.concurrency;
+    if (options.openLoop) std::cout << ", target QPS: " << options.targetQps;
+    std::cout << "\n";
+
+    std::cout << "Queries: " << report.queries << " (" << report.errors << " errors) in "
+        << report.seconds << "s, QPS: " << report.qps << "\n";
+    std::cout << "Latency ms  p50: " << report.p50
+        << "  p95: " << report.p95
+        << "  p99: " << report.p99
+        << "  p999: " << report.p999 << "\n";
+    if (report.rankAllocationsPerCandidate >= 0.0) {
+        std::cout << "Rank heap allocations per candidate: " << std::setprecision(3)
+            << report.rankAllocationsPerCandidate << std::setprecision(2) << "\n";
+    }
+
+    if (report.recallAtK >= 0.0) {
+        std::cout << "Recall@" << options.topK << ": " << std::setprecision(4) << report.recallAtK << "\n";
+    }
+    std::cout << std::defaultfloat;
+}
+
+// Scores synthetic candidates shaped like real rows, title text and token_stats literals
+RerankBenchmarkReport SearchBenchmark::runRerank(size_t candidates, size_t iterations)
+{
+    static const std::array<const char*, 8> words = {
+        "neural", "network", "learning", "history", "deep", "model", "language", "computer"
+    };
+
+    std::mt19937_64 rng(1);
+    std::vector<std::string> titles, stats;
+    std::vector<float> knn;
+    for (size_t i = 0; i < candidates; ++i) {
+        std::string title = std::string(words[rng() % words.size()]) + " " + words[rng() % words.size()];
+
+        // a few hundred distinct tokens per article, some of them query tokens
+        std::string s = "{";
+        for (int t = 0; t < 300; ++t) {
+            int64_t hash = t < 8 ? hashToken(words[t]) : static_cast<int64_t>(rng());
+            if (t) s += ",";
+            s += "\"(" + std::to_string(hash) + "," + std::to_string(1 + rng() % 20) + ")\"";
+        }
+        s += "}";
+
+        titles.push_back(std::move(title));
+        stats.push_back(std::move(s));
+        knn.push_back(0.5f + static_cast<float>(rng() % 100) / 200.0f);
+    }
+
+    SearchConfig config;
+    RerankBenchmarkReport report;
+    report.candidates = candidates;
+    report.iterations = iterations;
+
+    std::array<std::byte, SEARCH_ARENA_BYTES> arenaBuffer;
+    std::pmr::monotonic_buffer_resource arena(arenaBuffer.data(), arenaBuffer.size());
+    QueryFeatures features(&arena);
+
+    auto featuresStart = Clock::now();
+    for (size_t it = 0; it < iterations; ++it) {
+        buildQueryFeatures("What is the history of neural networks?", features);
+    }
+    report.nsPerQueryFeatures =
+        std::chrono::duration<double, std::nano>(Clock::now() - featuresStart).count() / std::max<size_t>(iterations, 1);
+
+    float sink = 0.0f;
+    uint64_t allocationsBefore = AllocationCounter::threadAllocations();
+    auto start = Clock::now();
+    for (size_t it = 0; it < iterations; ++it) {
+        for (size_t i = 0; i < candidates; ++i) {
+            sink += rerankScore(features, config, knn[i], titles[i], stats[i]);
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    uint64_t allocations = AllocationCounter::threadAllocations() - allocationsBefore;
+
+    size_t scoredTotal = std::max<size_t>(candidates * iterations, 1);
+    report.nsPerCandidate = elapsed / scoredTotal;
+    report.allocationsPerCandidate = static_cast<double>(allocations) / scoredTotal;
+
+    if (sink < 0.0f) std::cout << "";    // keep the scoring loop from being optimized away
+    return report;
+}
+
+void SearchBenchmark::printRerankReport(const RerankBenchmarkReport& report)
+{
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Reranked " << report.candidates << " candidates x " << report.iterations << " iterations\n";
+    std::cout << "Query features: " << report.nsPerQueryFeatures << " ns per query\n";
+    std::cout << "Rerank: " << report.nsPerCandidate << " ns per candidate\n";
+    std::cout << "Heap allocations per candidate: " << std::setprecision(3) << report.allocationsPerCandidate << "\n";
+    std::cout << std::defaultfloat;
+}
+
+// Read non-empty lines of the query log
+std::vector<std::string> SearchBenchmark::loadQueries(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not open query log: " + path);
+    }
+
+    std::vector<std::string> queries;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) queries.push_back(line);
+    }
+    return queries;
+}
+
+// The paged path opens a session per query, like the interactive search, sessions are left to expire
+void SearchBenchmark::runQuery(const std::string& query, const BenchmarkOptions& options)
+{
+    if (options.paged)
+        storage.searchPage(query, options.topK, config);
+    else
+        storage.search(query, options.topK, config);
+}
+
+// Closed loop, each worker issues its next query as soon as the previous one returns
+std::vector<double> SearchBenchmark::runClosedLoop(
+    const std::vector<std::string>& queries,
+    const BenchmarkOptions& options,
+    size_t& errors)
+{
+    size_t total = queries.size() * std::max<size_t>(options.rounds, 1);
+    size_t workers = std::max<size_t>(options.concurrency, 1);
+
+    std::atomic<size_t> next{ 0 };
+    std::atomic<size_t> failed{ 0 };
+    std::vector<std::vector<double>> perWorker(workers);
+    std::vector<std::thread> threads;
+
+    for (size_t w = 0; w < workers; ++w) {
+        threads.emplace_back([&, w] {
+            size_t i;
+            while ((i = next.fetch_add(1)) < total) {
+                auto begin = Clock::now();
+                try {
+                    runQuery(queries[i % queries.size()], options);
+                }
+                catch (const std::exception& e) {
+                    failed++;
+                    std::cerr << "Query failed: " << e.what() << "\n";
+                    continue;
+                }
+                perWorker[w].push_back(
+                    std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    std::vector<double> latencies;
+    for (auto& v : perWorker) latencies.insert(latencies.end(), v.begin(), v.end());
+    errors = failed;
+    return latencies;
+}
+
+// Open loop, arrivals follow a Poisson process independent of how fast queries complete
+std::vector<double> SearchBenchmark::runOpenLoop(
+    const std::vector<std::string>& queries,
+    const BenchmarkOptions& options,
+    size_t& errors)
+{
+    size_t total = queries.size() * std::max<size_t>(options.rounds, 1);
+    size_t workers = std::max<size_t>(options.concurrency, 1);
+    double qps = options.targetQps > 0.0 ? options.targetQps : 1.0;
+
+	// Precompute arrival offsets so the schedule doesn't depend on worker progress
+    std::mt19937_64 rng(42);
+    std::exponential_distribution<double> gap(qps);
+    std::vector<Clock::duration> arrivals(total);
+    double t = 0.0;
+    for (auto& a : arrivals) {
+        a = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(t));
+        t += gap(rng);
+    }
+
+    std::atomic<size_t> next{ 0 };
+    std::atomic<size_t> failed{ 0 };
+    std::vector<std::vector<double>> perWorker(workers);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+
+    for (size_t w = 0; w < workers; ++w) {
+        threads.emplace_back([&, w] {
+            size_t i;
+            while ((i = next.fetch_add(1)) < total) {
+                auto scheduled = start + arrivals[i];
+                std::this_thread::sleep_until(scheduled);
+                try {
+                    runQuery(queries[i % queries.size()], options);
+                }
+                catch (const std::exception& e) {
+                    failed++;
+                    std::cerr << "Query failed: " << e.what() << "\n";
+                    continue;
+                }
+                // measured from the scheduled arrival so queueing delay is included
+                perWorker[w].push_back(
+                    std::chrono::duration<double, std::milli>(Clock::now() - scheduled).count());
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    std::vector<double> latencies;
+    for (auto& v : perWorker) latencies.insert(latencies.end(), v.begin(), v.end());
+    errors = failed;
+    return latencies;
+}
+
+// Mean overlap of result ids with the exact-scan pipeline over each distinct query
+double SearchBenchmark::recallAtK(const std::vector<std::string>& queries, size_t topK)
+{
+	// Ground truth is an exact scan of the full embedding in Postgres, not the flat index or reduced vectors the
+	// measured run may use, so their loss shows up in recall
+    SearchConfig exactConfig = config;
+    exactConfig.exact = true;
+    exactConfig.useFlatIndex = false;
+    exactConfig.useReduced = false;
+
+    std::unordered_set<std::string> seen;
+    double total = 0.0;
+    size_t counted = 0;
+
+    for (const auto& q : queries) {
+        if (!seen.insert(q).second) continue;
+
+        try {
+            auto expected = storage.search(q, topK, exactConfig);
+            if (expected.empty()) continue;
+            auto actual = storage.search(q, topK, config);
+
+            std::unordered_set<int64_t> expectedIds;
+            for (const auto& r : expected) expectedIds.insert(r.id);
+
+            size_t hits = 0;
+            for (const auto& r : actual) hits += expectedIds.count(r.id);
+
+            total += static_cast<double>(hits) / static_cast<double>(expectedIds.size());
+            counted++;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Recall query failed: " << e.what() << "\n";
+        }
+    }
+
+    return counted ? total / counted : 0.0;
+}
+
+// Nearest-rank percentile of an already sorted list
+double SearchBenchmark::percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
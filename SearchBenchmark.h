@@ -0,0 +1,92 @@
+#pragma once
+#include "VectorStorage.h"
+
+#include <string>
+#include <vector>
+
+/*
+This class replays a query log against VectorStorage::search or searchPage to measure latency, throughput and recall.
+Recall@k compares the ANN + rerank pipeline against the same pipeline fed by an exact cosine scan.
+Every change to ef_search, expandFactor or the scoring weights should be signed off with it.
+*/
+
+// Options for a benchmark run
+struct BenchmarkOptions {
+    std::string queryLogPath;       // one query per line
+    size_t concurrency = 4;         // worker threads issuing queries
+    bool openLoop = false;          // false: closed loop, true: Poisson arrivals at targetQps
+    double targetQps = 20.0;        // arrival rate for open loop
+    size_t rounds = 1;              // times the query log is replayed
+    size_t topK = 10;               // results requested per query
+    bool computeRecall = true;      // also compute recall@k against exact search
+    bool paged = false;             // issue first pages through searchPage, the interactive path
+};
+
+// Results of a benchmark run, latencies in milliseconds
+struct BenchmarkReport {
+    size_t queries = 0;
+    size_t errors = 0;
+    double seconds = 0.0;
+    double qps = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double p999 = 0.0;
+    double recallAtK = -1.0;        // -1 when recall was not computed
+    double rankAllocationsPerCandidate = -1.0;  // heap allocations while ranking in the search path, -1 when nothing was ranked client side
+};
+
+// Results of the rerank microbenchmark
+struct RerankBenchmarkReport {
+    size_t candidates = 0;
+    size_t iterations = 0;
+    double nsPerCandidate = 0.0;
+    double nsPerQueryFeatures = 0.0;        // buildQueryFeatures cost, paid once per search
+    double allocationsPerCandidate = 0.0;
+};
+
+class SearchBenchmark {
+public:
+    SearchBenchmark(
+        VectorStorage& storage,
+        const SearchConfig& config
+    );
+
+    BenchmarkReport run(const BenchmarkOptions& options);
+
+    static void printReport(const BenchmarkReport& report, const BenchmarkOptions& options);
+
+    // Score synthetic candidates with the rerank path, no database or model needed
+    static RerankBenchmarkReport runRerank(size_t candidates, size_t iterations);
+    static void printRerankReport(const RerankBenchmarkReport& report);
+
+private:
+    VectorStorage& storage;
+    SearchConfig config;    // config under test
+
+    std::vector<std::string> loadQueries(const std::string& path);
+
+    // One timed query through search or searchPage
+    void runQuery(const std::string& query, const BenchmarkOptions& options);
+
+    // Issue queries back to back from each worker, returns per-query latencies
+    std::vector<double> runClosedLoop(
+        const std::vector<std::string>& queries,
+        const BenchmarkOptions& options,
+        size_t& errors
+    );
+
+    // Issue queries at Poisson arrival times, latency measured from the scheduled arrival
+    std::vector<double> runOpenLoop(
+        const std::vector<std::string>& queries,
+        const BenchmarkOptions& options,
+        size_t& errors
+    );
+
+    double recallAtK(
+        const std::vector<std::string>& queries,
+        size_t topK
+    );
+
+    static double percentile(const std::vector<double>& sorted, double p);
+};
@@ -0,0 +1,128 @@
+#include "SearchSession.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+
+size_t SearchSession::bytes() const
+{
+    return sizeof(*this)
+        + query.capacity() + entityQuery.capacity()
+        + queryVec.capacity() + annColumn.capacity() + annVec.capacity()
+        + filter.category.capacity() + filter.updatedAfter.capacity() + filter.updatedBefore.capacity()
+        + queryEmbedding.capacity() * sizeof(float)
+        + seenIds.capacity() * sizeof(int64_t)
+        + pending.capacity() * sizeof(ScoredId);
+}
+
+// Constructor
+SearchSessionStore::SearchSessionStore(std::chrono::seconds ttl, size_t maxBytes, size_t maxSessions)
+    : ttl(ttl),
+    maxBytes(maxBytes),
+    maxSessions(std::max<size_t>(maxSessions, 1)) {
+}
+
+std::string SearchSessionStore::add(std::shared_ptr<SearchSession> session)
+{
+    size_t sessionBytes = session->bytes();
+
+    std::lock_guard lock(mutex);
+
+	// 128 bits straight from the OS random source, a seeded generator could be predicted from cursors it handed out
+    std::string cursor;
+    do {
+        char buf[33];
+        std::snprintf(buf, sizeof(buf), "%08x%08x%08x%08x",
+            static_cast<unsigned>(random()), static_cast<unsigned>(random()),
+            static_cast<unsigned>(random()), static_cast<unsigned>(random()));
+        cursor = buf;
+    } while (entries.count(cursor));
+
+    auto now = Clock::now();
+    entries.emplace(cursor, Entry{ std::move(session), now, sessionBytes });
+    totalBytes += sessionBytes;
+    evict(now, cursor);
+    return cursor;
+}
+
+std::shared_ptr<SearchSession> SearchSessionStore::find(const std::string& cursor)
+{
+    std::lock_guard lock(mutex);
+    auto now = Clock::now();
+
+    auto it = entries.find(cursor);
+    if (it == entries.end()) return nullptr;
+    if (now - it->second.lastUsed > ttl) {
+        totalBytes -= it->second.bytes;
+        entries.erase(it);
+        return nullptr;
+    }
+
+    it->second.lastUsed = now;
+    return it->second.session;
+}
+
+void SearchSessionStore::update(const std::string& cursor, size_t bytes)
+{
+    std::lock_guard lock(mutex);
+
+    auto it = entries.find(cursor);
+    if (it == entries.end()) return;
+
+    totalBytes = totalBytes - it->second.bytes + bytes;
+    it->second.bytes = bytes;
+    it->second.lastUsed = Clock::now();
+    evict(it->second.lastUsed, cursor);
+}
+
+void SearchSessionStore::remove(const std::string& cursor)
+{
+    std::lock_guard lock(mutex);
+
+    auto it = entries.find(cursor);
+    if (it == entries.end()) return;
+    totalBytes -= it->second.bytes;
+    entries.erase(it);
+}
+
+size_t SearchSessionStore::size() const
+{
+    std::lock_guard lock(mutex);
+    return entries.size();
+}
+
+size_t SearchSessionStore::bytes() const
+{
+    std::lock_guard lock(mutex);
+    return totalBytes;
+}
+
+// Called with the mutex held, sessions are few so a linear scan per eviction is fine
+void SearchSessionStore::evict(Clock::time_point now, const std::string& keep)
+{
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->first != keep && now - it->second.lastUsed > ttl) {
+            totalBytes -= it->second.bytes;
+            it = entries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    while ((totalBytes > maxBytes || entries.size() > maxSessions) && entries.size() > 1) {
+        auto oldest = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->first == keep) continue;
+            if (oldest == entries.end() || it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+        }
+        if (oldest == entries.end()) break;
+
+        totalBytes -= oldest->second.bytes;
+        entries.erase(oldest);
+    }
+}
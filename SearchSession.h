@@ -0,0 +1,84 @@
+#pragma once
+#include "VectorStorage.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+Server-side state behind a search cursor, so following pages don't re-embed the query or re-scan the index.
+A session keeps the query embedding and an over-fetched, already reranked list of candidate ids that pages are cut from,
+the text of a page's rows is read when the page is served, so a session holds a few bytes per candidate.
+When the list runs out the index scan is continued past the ids already seen, see VectorStorage::nextPage.
+Sessions expire after a TTL, the store evicts least recently used sessions to stay within its memory budget.
+*/
+
+// State of one paginated search
+struct SearchSession {
+    std::mutex mutex;                   // one page request at a time per cursor
+
+    std::string query;
+    std::string entityQuery;
+    SearchConfig config;
+    SearchFilter filter;
+    std::vector<float> queryEmbedding;
+    std::string queryVec;               // pgvector literals, built once
+    std::string annColumn;
+    std::string annVec;
+
+    std::vector<ScoredId> pending;      // reranked candidates not served yet, best first
+    std::vector<int64_t> seenIds;       // every candidate fetched so far, excluded when the scan is continued
+    size_t served = 0;
+    bool exhausted = false;             // the index has no rows left past seenIds
+
+    size_t bytes() const;               // approximate memory held
+};
+
+class SearchSessionStore {
+public:
+    SearchSessionStore(
+        std::chrono::seconds ttl,
+        size_t maxBytes,
+        size_t maxSessions
+    );
+
+    // Store a session and return its cursor, may evict other sessions
+    std::string add(std::shared_ptr<SearchSession> session);
+
+    // Null when the cursor is unknown, expired or was evicted, refreshes the TTL
+    std::shared_ptr<SearchSession> find(const std::string& cursor);
+
+    // Re-account a session's memory after it changed, may evict other sessions
+    void update(const std::string& cursor, size_t bytes);
+
+    void remove(const std::string& cursor);
+
+    size_t size() const;
+    size_t bytes() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::shared_ptr<SearchSession> session;
+        Clock::time_point lastUsed;
+        size_t bytes;
+    };
+
+    // Drop expired sessions, then least recently used ones until within limits, keep is never evicted
+    void evict(Clock::time_point now, const std::string& keep);
+
+    std::chrono::seconds ttl;
+    size_t maxBytes;
+    size_t maxSessions;
+
+    std::unordered_map<std::string, Entry> entries;
+    size_t totalBytes = 0;
+    std::random_device random;          // cursor ids, the OS random source
+    mutable std::mutex mutex;
+};
@@ -0,0 +1,67 @@
+#include "../BatchSizer.h"
+#include "../WordPieceTokenizer.h"
+#include "Check.h"
+
+#include <chrono>
+#include <string>
+
+using Seconds = std::chrono::duration<double>;
+
+static void testEstimateTokens()
+{
+    size_t overhead = BatchSizer::estimateTokens("");
+    CHECK(overhead > 0);
+    CHECK(BatchSizer::estimateTokens("one two  three\n\tfour") == overhead + 4);
+    CHECK(BatchSizer::estimateTokens("   ") == overhead);
+
+	// Texts are truncated to the sequence length, a long article costs as much as one at the limit
+    std::string atLimit, longText;
+    for (size_t i = 0; i < EMBED_MAX_TOKENS; ++i) atLimit += "word ";
+    for (size_t i = 0; i < 50 * EMBED_MAX_TOKENS; ++i) longText += "word ";
+    CHECK(BatchSizer::estimateTokens(atLimit) == overhead + EMBED_MAX_TOKENS);
+    CHECK(BatchSizer::estimateTokens(longText) == overhead + EMBED_MAX_TOKENS);
+}
+
+static void testBudgetClamped()
+{
+    CHECK(BatchSizer(5, 0, 100, 1000).tokenBudget() == 100);
+    CHECK(BatchSizer(5000, 0, 100, 1000).tokenBudget() == 1000);
+    CHECK(BatchSizer(500, 0, 100, 1000).tokenBudget() == 500);
+}
+
+static void testHillClimb()
+{
+    BatchSizer sizer(1000, 0, 100, 10'000);
+
+	// Grows while throughput holds, reverses once it drops
+    sizer.record(10, 1000, Seconds(1.0));
+    CHECK(sizer.tokenBudget() == 1250);
+    sizer.record(10, 1250, Seconds(1.0));
+    CHECK(sizer.tokenBudget() == 1562);
+    sizer.record(10, 500, Seconds(1.0));
+    CHECK(sizer.tokenBudget() == 1249);
+
+	// Never leaves [minBudget, maxBudget]
+    BatchSizer capped(9000, 0, 100, 10'000);
+    for (int i = 0; i < 5; ++i) capped.record(10, 9000, Seconds(1.0));
+    CHECK(capped.tokenBudget() == 10'000);
+}
+
+static void testMemoryLimitHalves()
+{
+	// A one byte limit is always exceeded, every batch halves the budget down to the minimum
+    BatchSizer sizer(1000, 1, 300, 10'000);
+    sizer.record(10, 1000, Seconds(1.0));
+    CHECK(sizer.tokenBudget() == 500);
+    sizer.record(10, 1000, Seconds(1.0));
+    CHECK(sizer.tokenBudget() == 300);
+}
+
+int main()
+{
+    testEstimateTokens();
+    testBudgetClamped();
+    testHillClimb();
+    testMemoryLimitHalves();
+    return checkResult("BatchSizerTests");
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <iostream>
+
+/*
+Minimal checks for the standalone test programs in this directory, there is no test framework dependency.
+A failed CHECK prints its location and the test keeps running, the program exits non-zero if any check failed.
+*/
+
+inline int checkFailures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " << #cond << "\n"; \
+            ++checkFailures; \
+        } \
+    } while (0)
+
+// Print the outcome and return the process exit code
+inline int checkResult(const char* suite)
+{
+    std::cout << suite << ": " << (checkFailures ? "FAILED" : "passed");
+    if (checkFailures) std::cout << " (" << checkFailures << " failed checks)";
+    std::cout << "\n";
+    return checkFailures ? 1 : 0;
+}
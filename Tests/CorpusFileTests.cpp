@@ -0,0 +1,145 @@
+#include "../CorpusFile.h"
+#include "../TextUtils.h"
+#include "Check.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct SourceArticle {
+    std::string title;
+    std::string text;
+    int32_t ns;
+    int32_t length;
+    std::string timestamp;
+    std::string categories;
+};
+
+static std::vector<SourceArticle> sampleArticles()
+{
+    std::vector<SourceArticle> articles;
+    for (int i = 0; i < 10; ++i) {
+        std::string n = std::to_string(i);
+        articles.push_back({
+            "title " + n,
+            i == 4 ? std::string() : "Article " + n + " text about neural networks and networks of " + n,
+            i % 3,
+            1000 + i,
+            i % 2 ? "2024-01-0" + n + "T00:00:00Z" : "",
+            i % 2 ? "science\nliving_people" : ""
+        });
+    }
+    return articles;
+}
+
+static bool sameStats(const std::vector<TokenStat>& a, const std::vector<TokenStat>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].hash != b[i].hash || a[i].freq != b[i].freq) return false;
+    }
+    return true;
+}
+
+// Blocks of 3 articles, so the last block is partial
+static void testRoundTrip(bool compress)
+{
+    fs::path path = fs::temp_directory_path() / (compress ? "corpus_test_bz2.edbc" : "corpus_test.edbc");
+    auto source = sampleArticles();
+    {
+        CorpusWriter writer(path.string(), compress, 3);
+        for (const auto& a : source) {
+            writer.add(a.title, a.text, ArticleMeta{ a.ns, a.length, a.timestamp, a.categories });
+        }
+        writer.finish();
+        CHECK(writer.articleCount() == source.size());
+    }
+
+    CorpusReader reader(path.string());
+    CHECK(reader.compressed() == compress);
+    CHECK(reader.articleCount() == source.size());
+    CHECK(reader.blockCount() == 4);
+
+    size_t i = 0;
+    for (size_t b = 0; b < reader.blockCount(); ++b) {
+        CorpusBlock block = reader.readBlock(b);
+        CHECK(block.buffers.empty() != compress);
+        for (const auto& article : block.articles) {
+            if (i >= source.size()) break;
+            const auto& a = source[i++];
+            CHECK(article.title == a.title);
+            CHECK(article.text == a.text);
+            CHECK(article.meta.ns == a.ns);
+            CHECK(article.meta.length == a.length);
+            CHECK(article.meta.timestamp == a.timestamp);
+            CHECK(article.meta.categories == a.categories);
+            CHECK(sameStats(decodeTokenStats(article.tokenStats), computeTokenStats(a.text)));
+        }
+    }
+    CHECK(i == source.size());
+    fs::remove(path);
+}
+
+static void testEmptyCorpus()
+{
+    fs::path path = fs::temp_directory_path() / "corpus_test_empty.edbc";
+    {
+        CorpusWriter writer(path.string());
+    }
+    CorpusReader reader(path.string());
+    CHECK(reader.articleCount() == 0);
+    CHECK(reader.blockCount() == 0);
+    fs::remove(path);
+}
+
+static bool readerThrows(const fs::path& path)
+{
+    try {
+        CorpusReader reader(path.string());
+    }
+    catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+static void testRejectsDamagedFiles()
+{
+    fs::path path = fs::temp_directory_path() / "corpus_test_full.edbc";
+    fs::path damaged = fs::temp_directory_path() / "corpus_test_damaged.edbc";
+    {
+        CorpusWriter writer(path.string(), false, 3);
+        for (const auto& a : sampleArticles()) writer.add(a.title, a.text);
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    for (size_t keep : { bytes.size() / 2, bytes.size() - 1, static_cast<size_t>(16) }) {
+        std::ofstream(damaged, std::ios::binary | std::ios::trunc).write(bytes.data(), keep);
+        CHECK(readerThrows(damaged));
+    }
+
+    std::string notCorpus(bytes.size(), 'x');
+    std::ofstream(damaged, std::ios::binary | std::ios::trunc).write(notCorpus.data(), notCorpus.size());
+    CHECK(readerThrows(damaged));
+
+    fs::remove(path);
+    fs::remove(damaged);
+}
+
+int main()
+{
+    testRoundTrip(false);
+    testRoundTrip(true);
+    testEmptyCorpus();
+    testRejectsDamagedFiles();
+    return checkResult("CorpusFileTests");
+}
@@ -0,0 +1,105 @@
+#include "../EmbeddingProjection.h"
+#include "Check.h"
+
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// Samples spread along two axes of an 8-dim space plus a little noise, centered on an offset
+static std::vector<std::vector<float>> planarSamples(size_t count)
+{
+    std::mt19937 rng(11);
+    std::normal_distribution<float> wide(0.0f, 3.0f);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+
+    std::vector<std::vector<float>> samples;
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<float> v(8);
+        for (auto& x : v) x = 1.0f + noise(rng);
+        v[2] += wide(rng);
+        v[5] += wide(rng);
+        samples.push_back(v);
+    }
+    return samples;
+}
+
+static void testLearnFindsThePlane()
+{
+    auto samples = planarSamples(500);
+    EmbeddingProjection proj = EmbeddingProjection::learn(samples, 2);
+
+    CHECK(proj.inputDim() == 8);
+    CHECK(proj.outputDim() == 2);
+    CHECK(!proj.empty());
+    CHECK(proj.getExplainedVariance() > 0.99);
+
+	// Components are orthonormal and lie in the plane of axes 2 and 5
+    const auto& c = proj.getComponents();
+    for (size_t i = 0; i < 2; ++i) {
+        double norm = 0.0;
+        for (size_t j = 0; j < 8; ++j) norm += c[i * 8 + j] * c[i * 8 + j];
+        double inPlane = c[i * 8 + 2] * c[i * 8 + 2] + c[i * 8 + 5] * c[i * 8 + 5];
+        CHECK(std::abs(norm - 1.0) < 1e-4);
+        CHECK(inPlane > 0.99);
+    }
+    double dot = 0.0;
+    for (size_t j = 0; j < 8; ++j) dot += c[j] * c[8 + j];
+    CHECK(std::abs(dot) < 1e-4);
+
+	// The mean projects to the origin, distances within the plane are kept
+    auto origin = proj.project(proj.getMean());
+    CHECK(origin.size() == 2);
+    CHECK(std::abs(origin[0]) < 1e-5f && std::abs(origin[1]) < 1e-5f);
+
+    std::vector<float> moved = proj.getMean();
+    moved[2] += 3.0f;
+    moved[5] += 4.0f;
+    auto p = proj.project(moved);
+    CHECK(std::abs(std::sqrt(p[0] * p[0] + p[1] * p[1]) - 5.0f) < 1e-3f);
+}
+
+static void testProjectRejectsWrongDimension()
+{
+    EmbeddingProjection proj(3, 1, { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f });
+    CHECK(proj.project(std::vector<float>{ 1.0f, 2.0f }).empty());
+    CHECK((proj.project(std::vector<float>{ 2.0f, 5.0f, 7.0f }) == std::vector<float>{ 2.0f }));
+    CHECK(EmbeddingProjection().empty());
+}
+
+static void testInvalidArguments()
+{
+    auto samples = planarSamples(10);
+    auto throwsInvalid = [](auto&& f) {
+        try {
+            f();
+        }
+        catch (const std::invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+
+    CHECK(throwsInvalid([&] { EmbeddingProjection::learn(samples, 0); }));
+    CHECK(throwsInvalid([&] { EmbeddingProjection::learn(samples, 9); }));
+    CHECK(throwsInvalid([&] { EmbeddingProjection::learn({ samples[0] }, 1); }));
+    CHECK(throwsInvalid([&] { EmbeddingProjection::learn({ samples[0], { 1.0f } }, 1); }));
+    CHECK(throwsInvalid([] { EmbeddingProjection(2, 1, { 0.0f }, { 1.0f, 0.0f }); }));
+}
+
+static void testParseFloatList()
+{
+    CHECK((parseFloatList("[1,2.5,-3]") == std::vector<float>{ 1.0f, 2.5f, -3.0f }));
+    CHECK((parseFloatList("{0.25, 4}") == std::vector<float>{ 0.25f, 4.0f }));
+    CHECK(parseFloatList("[]").empty());
+    CHECK((parseFloatList("[1,x,2]") == std::vector<float>{ 1.0f }));
+}
+
+int main()
+{
+    testLearnFindsThePlane();
+    testProjectRejectsWrongDimension();
+    testInvalidArguments();
+    testParseFloatList();
+    return checkResult("EmbeddingProjectionTests");
+}
@@ -0,0 +1,86 @@
+#include "../EmbeddingProtocol.h"
+#include "Check.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static std::string u32(uint32_t v)
+{
+    std::string bytes(sizeof(v), '\0');
+    std::memcpy(bytes.data(), &v, sizeof(v));
+    return bytes;
+}
+
+static void testRequestRoundTrip()
+{
+    std::vector<std::string_view> texts = { "first article", "", "third \xe2\x9c\x93" };
+    std::string body = encodeEmbedRequest(texts);
+    CHECK(body.size() == 4 + 3 * 4 + 13 + 0 + 9);
+
+    std::vector<std::string_view> decoded;
+    CHECK(decodeEmbedRequest(body, decoded));
+    CHECK(decoded == texts);
+
+    CHECK(decodeEmbedRequest(encodeEmbedRequest({}), decoded));
+    CHECK(decoded.empty());
+}
+
+static void testRequestBounds()
+{
+    std::string body = encodeEmbedRequest({ "abc", "defg" });
+    std::vector<std::string_view> decoded;
+
+	// Every truncation and a trailing byte are rejected
+    for (size_t n = 0; n < body.size(); ++n) {
+        CHECK(!decodeEmbedRequest(std::string_view(body).substr(0, n), decoded));
+    }
+    CHECK(!decodeEmbedRequest(body + "x", decoded));
+
+	// Lengths and counts past the body, a huge count must not be reserved up front
+    CHECK(!decodeEmbedRequest(u32(1) + u32(100) + "short", decoded));
+    CHECK(!decodeEmbedRequest(u32(1) + u32(UINT32_MAX) + "x", decoded));
+    CHECK(!decodeEmbedRequest(u32(UINT32_MAX), decoded));
+    CHECK(!decodeEmbedRequest(u32(UINT32_MAX) + u32(0) + u32(0), decoded));
+}
+
+static void testResponseRoundTrip()
+{
+    EmbeddingMatrix sent(2, 3);
+    for (size_t i = 0; i < sent.values.size(); ++i) sent.values[i] = 0.5f * static_cast<float>(i);
+    std::string body = encodeEmbedResponse(sent);
+
+	// Decoded into rows 1..2 of a larger matrix, row 0 is left alone
+    EmbeddingMatrix out(3, 3);
+    out.row(0)[0] = 9.0f;
+    CHECK(decodeEmbedResponse(body, 2, out, 1));
+    CHECK(out.row(0)[0] == 9.0f);
+    for (size_t i = 0; i < sent.values.size(); ++i) CHECK(out.row(1)[i] == sent.values[i]);
+}
+
+static void testResponseBounds()
+{
+    EmbeddingMatrix sent(2, 3);
+    std::string body = encodeEmbedResponse(sent);
+    EmbeddingMatrix out(3, 3);
+
+    CHECK(!decodeEmbedResponse(body, 3, out, 0));              // count differs from the request
+    CHECK(!decodeEmbedResponse(body, 2, out, 2));              // rows past the end of out
+    EmbeddingMatrix wrongDim(2, 4);
+    CHECK(!decodeEmbedResponse(body, 2, wrongDim, 0));
+    CHECK(!decodeEmbedResponse(std::string_view(body).substr(0, body.size() - 1), 2, out, 0));
+    CHECK(!decodeEmbedResponse(body + "xxxx", 2, out, 0));
+    CHECK(!decodeEmbedResponse(u32(2), 2, out, 0));
+    CHECK(!decodeEmbedResponse(u32(UINT32_MAX) + u32(UINT32_MAX), UINT32_MAX, out, 0));
+}
+
+int main()
+{
+    testRequestRoundTrip();
+    testRequestBounds();
+    testResponseRoundTrip();
+    testResponseBounds();
+    return checkResult("EmbeddingProtocolTests");
+}
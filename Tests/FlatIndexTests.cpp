@@ -0,0 +1,172 @@
+#include "../FlatIndex.h"
+#include "Check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static std::vector<std::vector<float>> randomVectors(size_t count, size_t dim, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::vector<std::vector<float>> vectors(count, std::vector<float>(dim));
+    for (auto& v : vectors) {
+        for (auto& x : v) x = dist(rng);
+    }
+    return vectors;
+}
+
+static double scalarCosine(const std::vector<float>& a, const std::vector<float>& b)
+{
+    double dot = 0.0, na = 0.0, nb = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        dot += static_cast<double>(a[i]) * b[i];
+        na += static_cast<double>(a[i]) * a[i];
+        nb += static_cast<double>(b[i]) * b[i];
+    }
+    return dot / std::sqrt(na * nb);
+}
+
+static fs::path writeIndex(const std::string& name, const std::vector<std::vector<float>>& rows, FlatElement element)
+{
+    fs::path path = fs::temp_directory_path() / name;
+    FlatIndexWriter writer(path.string(), rows.front().size(), element);
+    for (size_t i = 0; i < rows.size(); ++i) writer.add(static_cast<int64_t>(1000 + i), rows[i]);
+    writer.finish();
+    return path;
+}
+
+// Compares the SIMD scan against a scalar double precision scan. Ids are compared through their true scores so
+// near ties that fp16 rounding reorders do not fail the test
+static void testMatchesScalar(FlatElement element, size_t dim, size_t count, double tolerance)
+{
+    auto rows = randomVectors(count, dim, 5);
+    auto queries = randomVectors(8, dim, 6);
+    fs::path path = writeIndex("flat_test.edbf", rows, element);
+
+    {
+        FlatIndex index(path.string());
+        CHECK(index.size() == count);
+        CHECK(index.dim() == dim);
+        CHECK(index.element() == element);
+
+        const size_t k = 10;
+        for (const auto& query : queries) {
+            std::vector<double> exact(count);
+            for (size_t i = 0; i < count; ++i) exact[i] = scalarCosine(query, rows[i]);
+            std::vector<double> sorted(exact);
+            std::sort(sorted.begin(), sorted.end(), std::greater<double>());
+
+            auto hits = index.search(query, k);
+            CHECK(hits.size() == k);
+            for (size_t i = 0; i < hits.size(); ++i) {
+                size_t row = static_cast<size_t>(hits[i].id - 1000);
+                CHECK(row < count);
+                if (row >= count) continue;
+                CHECK(std::abs(hits[i].score - exact[row]) < tolerance);
+                CHECK(std::abs(hits[i].score - sorted[i]) < tolerance);
+                if (i > 0) CHECK(hits[i - 1].score >= hits[i].score);
+            }
+        }
+
+	// A row is its own best match
+        auto self = index.search(rows[42], 1);
+        CHECK(self.size() == 1 && self[0].id == 1042);
+    }
+    fs::remove(path);
+}
+
+static void testEdgeCases()
+{
+    auto rows = randomVectors(5, 16, 7);
+    fs::path path = writeIndex("flat_test_small.edbf", rows, FlatElement::Float32);
+    {
+        FlatIndex index(path.string());
+        CHECK(index.search(rows[0], 100).size() == 5);
+        CHECK(index.search(rows[0], 0).empty());
+        CHECK(index.search(std::vector<float>(15, 1.0f), 3).empty());
+        CHECK(index.search(std::vector<float>(16, 0.0f), 3).empty());
+    }
+    fs::remove(path);
+}
+
+static bool indexThrows(const fs::path& path)
+{
+    try {
+        FlatIndex index(path.string());
+    }
+    catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+static void writeBytes(const fs::path& path, const std::string& bytes, size_t keep)
+{
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), keep);
+}
+
+static void testRejectsDamagedFiles()
+{
+    auto rows = randomVectors(20, 16, 8);
+    fs::path path = writeIndex("flat_test_full.edbf", rows, FlatElement::Float16);
+    fs::path damaged = fs::temp_directory_path() / "flat_test_damaged.edbf";
+
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    for (size_t keep : { bytes.size() - 1, bytes.size() / 2, static_cast<size_t>(64), static_cast<size_t>(10) }) {
+        writeBytes(damaged, bytes, keep);
+        CHECK(indexThrows(damaged));
+    }
+
+	// Header fields that would overflow the size checks or point past the matrix
+    std::string corrupt = bytes;
+    uint64_t hugeRows = UINT64_MAX / 2;
+    std::memcpy(corrupt.data() + 24, &hugeRows, sizeof(hugeRows));
+    writeBytes(damaged, corrupt, corrupt.size());
+    CHECK(indexThrows(damaged));
+
+    corrupt = bytes;
+    uint64_t badOffset = 8;
+    std::memcpy(corrupt.data() + 32, &badOffset, sizeof(badOffset));
+    writeBytes(damaged, corrupt, corrupt.size());
+    CHECK(indexThrows(damaged));
+
+    corrupt = bytes;
+    uint32_t badType = 7;
+    std::memcpy(corrupt.data() + 16, &badType, sizeof(badType));
+    writeBytes(damaged, corrupt, corrupt.size());
+    CHECK(indexThrows(damaged));
+
+    corrupt = bytes;
+    corrupt[0] = 'X';
+    writeBytes(damaged, corrupt, corrupt.size());
+    CHECK(indexThrows(damaged));
+
+    fs::remove(path);
+    fs::remove(damaged);
+}
+
+int main()
+{
+	// 9000 rows spans two scan blocks, 37 dims leaves a tail after every SIMD width
+    testMatchesScalar(FlatElement::Float32, 384, 9000, 1e-4);
+    testMatchesScalar(FlatElement::Float32, 37, 9000, 1e-4);
+    testMatchesScalar(FlatElement::Float16, 384, 9000, 2e-3);
+    testMatchesScalar(FlatElement::Float16, 37, 9000, 2e-3);
+    testEdgeCases();
+    testRejectsDamagedFiles();
+    return checkResult("FlatIndexTests");
+}
@@ -0,0 +1,157 @@
+#include "../SearchSession.h"
+#include "Check.h"
+
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+static std::shared_ptr<SearchSession> makeSession(size_t candidates)
+{
+    auto session = std::make_shared<SearchSession>();
+    session->query = "neural networks";
+    session->seenIds.assign(candidates, 1);
+    session->pending.assign(candidates, ScoredId{ 1, 0.5f });
+    return session;
+}
+
+// Spaces operations out so two sessions never share a lastUsed time
+static void tick()
+{
+    std::this_thread::sleep_for(2ms);
+}
+
+static void testCursorFormat()
+{
+    SearchSessionStore store(60s, SIZE_MAX, 1000);
+    std::set<std::string> cursors;
+    for (int i = 0; i < 200; ++i) {
+        std::string cursor = store.add(makeSession(1));
+        CHECK(cursor.size() == 32);
+        CHECK(cursor.find_first_not_of("0123456789abcdef") == std::string::npos);
+        cursors.insert(cursor);
+    }
+    CHECK(cursors.size() == 200);
+    CHECK(store.size() == 200);
+}
+
+static void testByteAccounting()
+{
+    SearchSessionStore store(60s, SIZE_MAX, 10);
+    auto a = makeSession(10);
+    auto b = makeSession(100);
+    size_t aBytes = a->bytes(), bBytes = b->bytes();
+
+    std::string ca = store.add(a);
+    std::string cb = store.add(b);
+    CHECK(store.bytes() == aBytes + bBytes);
+    CHECK(store.find(ca) == a);
+    CHECK(store.find(cb) == b);
+
+    store.update(ca, aBytes + 500);
+    CHECK(store.bytes() == aBytes + 500 + bBytes);
+
+    store.remove(cb);
+    CHECK(store.size() == 1);
+    CHECK(store.bytes() == aBytes + 500);
+    CHECK(store.find(cb) == nullptr);
+
+    store.remove(cb);
+    store.update(cb, 1);
+    store.remove("not a cursor");
+    CHECK(store.bytes() == aBytes + 500);
+    CHECK(store.find("not a cursor") == nullptr);
+}
+
+static void testEvictsByCount()
+{
+    SearchSessionStore store(60s, SIZE_MAX, 3);
+    std::string a = store.add(makeSession(1));
+    tick();
+    std::string b = store.add(makeSession(1));
+    tick();
+    std::string c = store.add(makeSession(1));
+    tick();
+
+	// Finding a makes b the least recently used
+    CHECK(store.find(a) != nullptr);
+    tick();
+    std::string d = store.add(makeSession(1));
+
+    CHECK(store.size() == 3);
+    CHECK(store.find(b) == nullptr);
+    CHECK(store.find(a) != nullptr);
+    CHECK(store.find(c) != nullptr);
+    CHECK(store.find(d) != nullptr);
+}
+
+static void testEvictsByBytes()
+{
+    size_t sessionBytes = makeSession(100)->bytes();
+    SearchSessionStore store(60s, sessionBytes * 2 + sessionBytes / 2, 100);
+
+    std::string a = store.add(makeSession(100));
+    tick();
+    std::string b = store.add(makeSession(100));
+    tick();
+    std::string c = store.add(makeSession(100));
+
+    CHECK(store.size() == 2);
+    CHECK(store.bytes() <= sessionBytes * 2 + sessionBytes / 2);
+    CHECK(store.find(a) == nullptr);
+    CHECK(store.find(b) != nullptr);
+    CHECK(store.find(c) != nullptr);
+    tick();
+
+	// A session that grows past the budget pushes the others out but is kept itself
+    store.update(b, sessionBytes * 10);
+    CHECK(store.size() == 1);
+    CHECK(store.find(b) != nullptr);
+    CHECK(store.find(c) == nullptr);
+    CHECK(store.bytes() == sessionBytes * 10);
+
+	// So is a new session larger than the whole budget
+    std::string big = store.add(makeSession(10000));
+    CHECK(store.size() == 1);
+    CHECK(store.find(big) != nullptr);
+}
+
+static void testExpires()
+{
+    SearchSessionStore store(0s, SIZE_MAX, 10);
+    std::string a = store.add(makeSession(1));
+    std::string b = store.add(makeSession(1));
+    tick();
+
+    CHECK(store.find(a) == nullptr);
+    CHECK(store.size() == 1);
+
+	// Adding sweeps the other expired sessions
+    store.add(makeSession(1));
+    CHECK(store.size() == 1);
+    CHECK(store.bytes() == makeSession(1)->bytes());
+    CHECK(store.find(b) == nullptr);
+
+    SearchSessionStore longLived(1s, SIZE_MAX, 10);
+    std::string d = longLived.add(makeSession(1));
+    std::this_thread::sleep_for(600ms);
+    CHECK(longLived.find(d) != nullptr);      // refreshes the TTL
+    std::this_thread::sleep_for(600ms);
+    CHECK(longLived.find(d) != nullptr);
+    std::this_thread::sleep_for(1100ms);
+    CHECK(longLived.find(d) == nullptr);
+}
+
+int main()
+{
+    testCursorFormat();
+    testByteAccounting();
+    testEvictsByCount();
+    testEvictsByBytes();
+    testExpires();
+    return checkResult("SearchSessionStoreTests");
+}
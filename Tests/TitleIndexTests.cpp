@@ -0,0 +1,101 @@
+#include "../TitleIndex.h"
+#include "Check.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Reference answer, every title with the prefix sorted by length then title
+static std::vector<std::string> shortestByScan(
+    const std::vector<std::pair<std::string, int64_t>>& titles, const std::string& prefix, size_t limit)
+{
+    std::vector<std::string> matches;
+    for (const auto& [title, id] : titles) {
+        if (title.compare(0, prefix.size(), prefix) == 0) matches.push_back(title);
+    }
+    std::sort(matches.begin(), matches.end(), [](const std::string& a, const std::string& b) {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+    if (matches.size() > limit) matches.resize(limit);
+    return matches;
+}
+
+static void testExact()
+{
+    TitleIndex index;
+    index.build({ { "paris", 1 }, { "paris hilton", 2 }, { "paris", 3 }, { "parish", 4 } });
+
+    auto ids = index.exact("paris");
+    std::sort(ids.begin(), ids.end());
+    CHECK((ids == std::vector<int64_t>{ 1, 3 }));
+    CHECK(index.exact("pari").empty());
+    CHECK(index.exact("london").empty());
+    CHECK(index.size() == 4);
+}
+
+static void testPrefixShortestFirst()
+{
+    TitleIndex index;
+    index.build({ { "apple pie", 1 }, { "apple", 2 }, { "applesauce", 3 }, { "banana", 4 } });
+
+    auto matches = index.suggest("app", 2);
+    CHECK(matches.size() == 2);
+    CHECK(matches[0].title == "apple" && matches[0].id == 2);
+    CHECK(matches[1].title == "apple pie");
+    CHECK((index.prefixIds("app", 10) == std::vector<int64_t>{ 2, 1, 3 }));
+    CHECK(index.suggest("cherry", 5).empty());
+    CHECK(index.suggest("app", 0).empty());
+}
+
+// Broad prefixes span many min-length blocks, the result has to match a full scan exactly
+static void testShortestMatchesScan()
+{
+    std::mt19937 rng(7);
+    std::vector<std::pair<std::string, int64_t>> titles;
+    for (int64_t i = 0; i < 20'000; ++i) {
+        std::string title;
+        size_t length = 1 + rng() % 14;
+        for (size_t c = 0; c < length; ++c) title.push_back(static_cast<char>('a' + rng() % 3));
+        titles.emplace_back(std::move(title), i);
+    }
+
+    TitleIndex index;
+    index.build({ titles.begin(), titles.begin() + 12'000 });
+    index.insert({ titles.begin() + 12'000, titles.end() });
+    CHECK(index.size() == titles.size());
+
+    for (std::string prefix : { "", "a", "bc", "cab", "aaaaaa", "cccccccccccc" }) {
+        for (size_t limit : { 1, 3, 10, 200 }) {
+            auto expected = shortestByScan(titles, prefix, limit);
+            auto matches = index.suggest(prefix, limit);
+            CHECK(matches.size() == expected.size());
+            for (size_t i = 0; i < std::min(matches.size(), expected.size()); ++i) {
+                CHECK(matches[i].title == expected[i]);
+            }
+        }
+    }
+}
+
+static void testInsertKeepsOrder()
+{
+    TitleIndex index;
+    index.build({ { "zeta", 1 }, { "alpha", 2 } });
+    index.insert({ { "beta", 3 }, { "al", 4 } });
+
+    CHECK((index.prefixIds("al", 5) == std::vector<int64_t>{ 4, 2 }));
+    CHECK((index.exact("beta") == std::vector<int64_t>{ 3 }));
+    index.insert({});
+    CHECK(index.size() == 4);
+}
+
+int main()
+{
+    testExact();
+    testPrefixShortestFirst();
+    testShortestMatchesScan();
+    testInsertKeepsOrder();
+    return checkResult("TitleIndexTests");
+}
@@ -0,0 +1,30 @@
+#include "TextArena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+
+// Constructor, initialBytes is the first arena block, later blocks grow geometrically
+TextArena::TextArena(size_t initialBytes)
+    : resource(std::max<size_t>(initialBytes, 1)) {
+}
+
+std::string_view TextArena::store(std::string_view s)
+{
+    if (s.empty()) return {};
+
+    char* p;
+    {
+        std::lock_guard lock(mutex);
+        p = static_cast<char*>(resource.allocate(s.size(), 1));
+    }
+    std::memcpy(p, s.data(), s.size());
+    stored.fetch_add(s.size(), std::memory_order_relaxed);
+    return { p, s.size() };
+}
+
+size_t TextArena::bytesStored() const
+{
+    return stored.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <string_view>
+
+/*
+This class holds article text for ingest batches in a monotonic arena, freed all at once when the last batch using it is done.
+Parser threads copy titles and texts in concurrently, only the bump allocation is locked.
+*/
+
+class TextArena {
+public:
+    explicit TextArena(size_t initialBytes);
+
+    TextArena(const TextArena&) = delete;
+    TextArena& operator=(const TextArena&) = delete;
+
+    // Copy s into the arena, the view stays valid for the arena's lifetime
+    std::string_view store(std::string_view s);
+
+    size_t bytesStored() const;     // bytes copied in so far
+
+private:
+    std::pmr::monotonic_buffer_resource resource;
+    std::mutex mutex;
+    std::atomic<size_t> stored{ 0 };
+};
@@ -0,0 +1,97 @@
+#include "TextUtils.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Sorted for binary search
+constexpr std::array<std::string_view, 22> STOPWORDS = {
+    "a", "an", "are", "define", "definition", "explain", "for", "how",
+    "in", "is", "of", "on", "the", "to", "was", "were",
+    "what", "when", "where", "who", "why", "with"
+};
+
+std::string cleanString(std::string_view text)
+{
+    std::string out;
+    cleanStringInto(text, out);
+    return out;
+}
+
+std::string_view stemToken(std::string_view word)
+{
+    if (word.size() > 3 && word.back() == 's') {
+        word.remove_suffix(1);
+    }
+    return word;
+}
+
+bool isStopword(std::string_view word)
+{
+    return std::binary_search(STOPWORDS.begin(), STOPWORDS.end(), word);
+}
+
+int64_t hashToken(std::string_view token)
+{
+    // std::hash<std::string_view> is required to match std::hash<std::string>
+    return static_cast<int64_t>(std::hash<std::string_view>{}(token));
+}
+
+std::string extractEntity(std::string_view query)
+{
+    static constexpr std::array<std::string_view, 5> prefixes = {
+        "what is", "what are", "define", "definition of", "explain"
+    };
+
+    std::string q = cleanString(query);
+    std::string_view rest = q;
+
+    for (auto p : prefixes) {
+        if (rest.starts_with(p)) {
+            rest.remove_prefix(p.size());
+            break;
+        }
+    }
+
+    std::string out;
+    out.reserve(rest.size());
+    forEachWord(rest, [&out](std::string_view word) {
+        if (word == "a" || word == "an" || word == "the") return;
+        if (!out.empty()) out.push_back(' ');
+        out.append(stemToken(word));
+    });
+
+    return out;
+}
+
+std::unordered_map<std::string, int> tokenizeWithFrequency(std::string_view text)
+{
+    std::string clean = cleanString(text);
+    std::unordered_map<std::string, int> freq;
+
+    forEachWord(clean, [&freq](std::string_view word) {
+        word = stemToken(word);
+        if (!isStopword(word)) {
+            freq[std::string(word)]++;
+        }
+    });
+
+    return freq;
+}
+
+std::vector<TokenStat> computeTokenStats(std::string_view text)
+{
+    auto freq = tokenizeWithFrequency(text);
+
+    std::vector<TokenStat> stats;
+    stats.reserve(freq.size());
+    for (const auto& [token, count] : freq) {
+        stats.push_back({ hashToken(token), static_cast<int16_t>(std::min(count, 32767)) });   // SMALLINT safety
+    }
+    return stats;
+}
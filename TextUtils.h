@@ -0,0 +1,59 @@
+#pragma once
+#include "PageItem.h"
+
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+Text normalization shared by ingest, search and the title index.
+Works on string_views and splits words without stringstreams, so the search path allocates only where it has to.
+*/
+
+std::string cleanString(std::string_view text);
+
+// Drops a plural "s" from words longer than 3 characters, the result is a view into word
+std::string_view stemToken(std::string_view word);
+
+bool isStopword(std::string_view word);
+
+// Same value as std::hash<std::string> of the token, stored in token_stats
+int64_t hashToken(std::string_view token);
+
+// Extracts main entity from query by removing common question words and articles, also normalizes text
+std::string extractEntity(std::string_view query);
+
+// Tokenize text and count frequency of each token, used for token_stats column
+std::unordered_map<std::string, int> tokenizeWithFrequency(std::string_view text);
+
+// Hashed token frequencies of text, the values stored in token_stats
+std::vector<TokenStat> computeTokenStats(std::string_view text);
+
+// Lowercase and strip punctuation, appended to out so callers can reuse a buffer or arena string
+template <typename String>
+void cleanStringInto(std::string_view text, String& out)
+{
+    out.reserve(out.size() + text.size());
+
+    for (unsigned char c : text) {
+        if (!std::ispunct(c)) {
+            out.push_back(static_cast<char>(std::tolower(c)));
+        }
+    }
+}
+
+// Calls f(word) for each whitespace separated word of text
+template <typename F>
+void forEachWord(std::string_view text, F&& f)
+{
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) ++i;
+        size_t start = i;
+        while (i < text.size() && !std::isspace(static_cast<unsigned char>(text[i]))) ++i;
+        if (i > start) f(text.substr(start, i - start));
+    }
+}
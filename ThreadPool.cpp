@@ -0,0 +1,111 @@
+#include "ThreadPool.h"
+#include "CpuBudget.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+thread_local ThreadPool* ThreadPool::currentPool = nullptr;
+thread_local size_t ThreadPool::currentIndex = 0;
+
+// Constructor, starts the workers
+ThreadPool::ThreadPool(size_t workerCount, bool pinThreads)
+{
+    for (size_t i = 0; i < workerCount; ++i) queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back([this, i, pinThreads] { workerLoop(i, pinThreads); });
+    }
+}
+
+// Destructor, runs what is still queued then joins
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool(CpuBudget::poolCores(), CpuBudget::pinThreads());
+    return pool;
+}
+
+size_t ThreadPool::workerCount() const
+{
+    return workers.size();
+}
+
+// Workers push to their own queue, other threads spread tasks round robin
+void ThreadPool::push(std::function<void()> task)
+{
+    size_t index = currentPool == this
+        ? currentIndex
+        : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    pending.fetch_add(1);
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);   // pairs with the wait predicate so the wake-up isn't lost
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::runPending()
+{
+    if (pending.load() == 0) return false;
+
+    std::function<void()> task;
+    bool own = currentPool == this;
+
+	// Newest task from our own queue keeps its data in cache
+    if (own) {
+        Queue& q = *queues[currentIndex];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        }
+    }
+
+	// Otherwise steal the oldest task of another queue
+    for (size_t k = 0; !task && k < queues.size(); ++k) {
+        size_t victim = own ? (currentIndex + 1 + k) % queues.size() : k;
+        Queue& q = *queues[victim];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+    }
+
+    if (!task) return false;
+    pending.fetch_sub(1);
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t index, bool pinThread)
+{
+    currentPool = this;
+    currentIndex = index;
+    if (pinThread) CpuBudget::pinCurrentThread(CpuBudget::inferenceCores() + index);   // after the ORT slots
+
+    while (true) {
+        if (runPending()) continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || pending.load() > 0; });
+        if (stopping && pending.load() == 0) return;
+    }
+}
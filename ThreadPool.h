@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+Work-stealing thread pool for CPU work outside ONNX Runtime: JSON parsing, tokenization and insert formatting.
+Each worker owns a deque, runs its own tasks newest first and steals the oldest tasks of other workers when idle.
+A parallelFor caller works through its own loop and never runs other queued tasks, so a query thread can't end up
+running ingest work. Helpers that haven't started once the caller runs out of indices are skipped, the caller only waits
+for helpers already running, so nested parallel loops can't deadlock.
+Blocking I/O doesn't belong here, it would hold a core of the budget while waiting.
+*/
+
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t workers, bool pinThreads = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Process-wide pool sized from CpuBudget, one worker less than the budget since callers also run work
+    static ThreadPool& shared();
+
+    // Run f on the pool, runs inline when the pool has no workers
+    template <typename F>
+    auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>>;
+
+    // Calls f(i) for every i in [begin, end), grain indices per task, the calling thread takes part
+    template <typename F>
+    void parallelFor(size_t begin, size_t end, size_t grain, F&& f);
+
+    size_t workerCount() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void push(std::function<void()> task);
+    bool runPending();          // run one queued task, own queue first, returns false if none was found
+    void workerLoop(size_t index, bool pinThread);
+
+    std::vector<std::unique_ptr<Queue>> queues;     // one per worker
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending{ 0 };               // queued tasks across all queues
+    std::atomic<size_t> nextQueue{ 0 };             // round robin for tasks pushed from outside the pool
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static thread_local ThreadPool* currentPool;    // pool of the calling worker thread
+    static thread_local size_t currentIndex;
+};
+
+template <typename F>
+auto ThreadPool::submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+{
+    using Result = std::invoke_result_t<std::decay_t<F>>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+    std::future<Result> result = task->get_future();
+
+    if (workers.empty()) (*task)();
+    else push([task] { (*task)(); });
+    return result;
+}
+
+template <typename F>
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, F&& f)
+{
+    if (begin >= end) return;
+    grain = std::max<size_t>(grain, 1);
+
+    size_t chunks = (end - begin + grain - 1) / grain;
+    size_t helpers = std::min(chunks - 1, workers.size());
+    if (helpers == 0) {
+        for (size_t i = begin; i < end; ++i) f(i);
+        return;
+    }
+
+	// Helpers check in under the group's lock, once the caller has closed the group they return without touching this frame
+    struct Group {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t running = 0;
+        bool closed = false;
+    };
+    auto group = std::make_shared<Group>();
+
+    std::atomic<size_t> next{ begin };
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto run = [&] {
+        try {
+            size_t start;
+            while ((start = next.fetch_add(grain)) < end) {
+                size_t stop = std::min(start + grain, end);
+                for (size_t i = start; i < stop; ++i) f(i);
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) error = std::current_exception();
+            next = end;
+        }
+    };
+
+    for (size_t h = 0; h < helpers; ++h) {
+        push([group, &run] {
+            {
+                std::lock_guard<std::mutex> lock(group->mutex);
+                if (group->closed) return;
+                ++group->running;
+            }
+            run();
+            // notify under the lock, the waiting frame can't unwind before it is released
+            std::lock_guard<std::mutex> lock(group->mutex);
+            if (--group->running == 0) group->done.notify_all();
+        });
+    }
+    run();
+
+	// Every index has been taken, wait only for helpers still working on theirs
+    {
+        std::unique_lock<std::mutex> lock(group->mutex);
+        group->closed = true;
+        group->done.wait(lock, [&group] { return group->running == 0; });
+    }
+
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,223 @@
+#include "TitleIndex.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Entries per block of the min-length index, blocks whose shortest title can't make the top k are skipped
+constexpr size_t TITLE_BLOCK_ENTRIES = 64;
+
+// Replace the whole index
+void TitleIndex::build(std::vector<std::pair<std::string, int64_t>> titles)
+{
+    size_t bytes = 0;
+    for (const auto& [title, id] : titles) bytes += title.size();
+    checkPoolSize(0, bytes);
+
+    std::unique_lock lock(mutex);
+
+    pool.clear();
+    entries.clear();
+    pool.reserve(bytes);
+    entries.reserve(titles.size());
+
+    for (const auto& [title, id] : titles) {
+        entries.push_back({
+            static_cast<uint32_t>(pool.size()),
+            static_cast<uint32_t>(title.size()),
+            id
+        });
+        pool.append(title);
+    }
+
+    sortEntries();
+}
+
+// Add newly ingested titles, merged into the sorted entries
+void TitleIndex::insert(const std::vector<std::pair<std::string, int64_t>>& titles)
+{
+    if (titles.empty()) return;
+
+    size_t bytes = 0;
+    for (const auto& [title, id] : titles) bytes += title.size();
+
+    std::unique_lock lock(mutex);
+    checkPoolSize(pool.size(), bytes);
+
+    size_t oldSize = entries.size();
+    for (const auto& [title, id] : titles) {
+        entries.push_back({
+            static_cast<uint32_t>(pool.size()),
+            static_cast<uint32_t>(title.size()),
+            id
+        });
+        pool.append(title);
+    }
+
+    auto less = [this](const Entry& a, const Entry& b) { return entryLess(a, b); };
+
+	// Sort only the new tail, then merge with the already sorted head
+    std::sort(entries.begin() + oldSize, entries.end(), less);
+    std::inplace_merge(entries.begin(), entries.begin() + oldSize, entries.end(), less);
+    updateBlockMins();
+}
+
+// Ids of all titles equal to the given title
+std::vector<int64_t> TitleIndex::exact(std::string_view title) const
+{
+    std::shared_lock lock(mutex);
+
+    std::vector<int64_t> ids;
+    auto [first, last] = prefixRange(title);
+    for (size_t i = first; i < last && titleOf(entries[i]) == title; ++i) {
+        ids.push_back(entries[i].id);
+    }
+    return ids;
+}
+
+// Ids of up to limit titles starting with prefix
+std::vector<int64_t> TitleIndex::prefixIds(std::string_view prefix, size_t limit) const
+{
+    std::shared_lock lock(mutex);
+
+    std::vector<int64_t> ids;
+    for (const Entry* e : pickShortest(prefixRange(prefix), limit)) {
+        ids.push_back(e->id);
+    }
+    return ids;
+}
+
+// Up to limit titles starting with prefix
+std::vector<TitleMatch> TitleIndex::suggest(std::string_view prefix, size_t limit) const
+{
+    std::shared_lock lock(mutex);
+
+    std::vector<TitleMatch> matches;
+    for (const Entry* e : pickShortest(prefixRange(prefix), limit)) {
+        matches.push_back({ e->id, std::string(titleOf(*e)) });
+    }
+    return matches;
+}
+
+size_t TitleIndex::size() const
+{
+    std::shared_lock lock(mutex);
+    return entries.size();
+}
+
+std::string_view TitleIndex::titleOf(const Entry& e) const
+{
+    return std::string_view(pool).substr(e.offset, e.length);
+}
+
+void TitleIndex::checkPoolSize(size_t poolBytes, size_t bytes) const
+{
+    if (poolBytes > UINT32_MAX || bytes > UINT32_MAX - poolBytes) {
+        throw std::length_error("title pool would exceed 4 GiB of 32-bit offsets");
+    }
+}
+
+// Orders entries by title, then id
+bool TitleIndex::entryLess(const Entry& a, const Entry& b) const
+{
+    std::string_view ta = titleOf(a), tb = titleOf(b);
+    return ta != tb ? ta < tb : a.id < b.id;
+}
+
+void TitleIndex::sortEntries()
+{
+    std::sort(entries.begin(), entries.end(),
+        [this](const Entry& a, const Entry& b) { return entryLess(a, b); });
+    updateBlockMins();
+}
+
+// Merged inserts can move entries into any block, so the whole index is rebuilt, caller must hold the lock
+void TitleIndex::updateBlockMins()
+{
+    blockMins.assign((entries.size() + TITLE_BLOCK_ENTRIES - 1) / TITLE_BLOCK_ENTRIES, UINT32_MAX);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        uint32_t& m = blockMins[i / TITLE_BLOCK_ENTRIES];
+        m = std::min(m, entries[i].length);
+    }
+}
+
+// Binary search for the range of entries starting with prefix, caller must hold the lock
+std::pair<size_t, size_t> TitleIndex::prefixRange(std::string_view prefix) const
+{
+    auto first = std::lower_bound(entries.begin(), entries.end(), prefix,
+        [this](const Entry& e, std::string_view p) {
+            return titleOf(e) < p;
+        });
+
+    auto last = std::upper_bound(first, entries.end(), prefix,
+        [this](std::string_view p, const Entry& e) {
+            return p < titleOf(e).substr(0, p.size());
+        });
+
+    return {
+        static_cast<size_t>(first - entries.begin()),
+        static_cast<size_t>(last - entries.begin())
+    };
+}
+
+// Picks up to limit entries from a range, shortest titles first, caller must hold the lock
+// Partial blocks at the ends are scanned, whole blocks are visited shortest first until none can beat the kept entries
+std::vector<const TitleIndex::Entry*> TitleIndex::pickShortest(std::pair<size_t, size_t> range, size_t limit) const
+{
+    auto [first, last] = range;
+    if (limit == 0 || first >= last) return {};
+
+    auto shorter = [this](const Entry* a, const Entry* b) {
+        return a->length != b->length ? a->length < b->length : titleOf(*a) < titleOf(*b);
+    };
+
+	// Max-heap of the best entries so far, front is the worst kept one
+    std::vector<const Entry*> picked;
+    picked.reserve(std::min(limit, last - first) + 1);
+    auto offer = [&](size_t from, size_t to) {
+        for (size_t i = from; i < to; ++i) {
+            const Entry* e = &entries[i];
+            if (picked.size() == limit) {
+                if (!shorter(e, picked.front())) continue;
+                std::pop_heap(picked.begin(), picked.end(), shorter);
+                picked.pop_back();
+            }
+            picked.push_back(e);
+            std::push_heap(picked.begin(), picked.end(), shorter);
+        }
+    };
+
+    size_t firstBlock = (first + TITLE_BLOCK_ENTRIES - 1) / TITLE_BLOCK_ENTRIES;
+    size_t lastBlock = last / TITLE_BLOCK_ENTRIES;
+    if (firstBlock >= lastBlock) {
+        offer(first, last);
+    }
+    else {
+        offer(first, firstBlock * TITLE_BLOCK_ENTRIES);
+        offer(lastBlock * TITLE_BLOCK_ENTRIES, last);
+
+        std::vector<std::pair<uint32_t, size_t>> blocks;    // (shortest length, block), min-heap
+        blocks.reserve(lastBlock - firstBlock);
+        for (size_t b = firstBlock; b < lastBlock; ++b) blocks.emplace_back(blockMins[b], b);
+        auto longer = [](const auto& a, const auto& b) { return a.first > b.first; };
+        std::make_heap(blocks.begin(), blocks.end(), longer);
+
+		// A block whose shortest title ties the worst kept one can still win on the title
+        while (!blocks.empty()) {
+            auto [minLength, b] = blocks.front();
+            if (picked.size() == limit && minLength > picked.front()->length) break;
+            std::pop_heap(blocks.begin(), blocks.end(), longer);
+            blocks.pop_back();
+            offer(b * TITLE_BLOCK_ENTRIES, (b + 1) * TITLE_BLOCK_ENTRIES);
+        }
+    }
+
+    std::sort_heap(picked.begin(), picked.end(), shorter);
+    return picked;
+}
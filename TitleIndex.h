@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+This class keeps an in-memory, sorted index of normalized article titles mapped to their ids.
+Titles are stored back to back in one string pool, entries only hold offsets, so a few million titles stay compact.
+Used for prefix autocomplete and to inject exact/prefix title matches into search without embedding or SQL work.
+The shortest title length of each block of entries is kept, so the shortest matches of a broad prefix are found
+exactly without sorting the whole range.
+*/
+
+// Holds a single title suggestion
+struct TitleMatch {
+    int64_t id;
+    std::string title;
+};
+
+class TitleIndex {
+public:
+    TitleIndex() = default;
+
+    // Replace the whole index, titles must already be normalized with cleanString
+    void build(std::vector<std::pair<std::string, int64_t>> titles);
+
+    // Add newly ingested titles, titles must already be normalized with cleanString
+    // build and insert throw std::length_error and leave the index unchanged if the pool would pass 4 GiB
+    void insert(const std::vector<std::pair<std::string, int64_t>>& titles);
+
+    // Ids of all titles equal to the given normalized title
+    std::vector<int64_t> exact(std::string_view title) const;
+
+    // Ids of up to limit titles starting with the given normalized prefix, shortest titles first
+    std::vector<int64_t> prefixIds(std::string_view prefix, size_t limit) const;
+
+    // Up to limit titles starting with the given normalized prefix, shortest titles first
+    std::vector<TitleMatch> suggest(std::string_view prefix, size_t limit) const;
+
+    size_t size() const;
+
+private:
+    struct Entry {
+        uint32_t offset;    // offset of title in pool
+        uint32_t length;    // length of title in pool
+        int64_t id;         // article id
+    };
+
+    std::string_view titleOf(const Entry& e) const;
+    bool entryLess(const Entry& a, const Entry& b) const;
+    void sortEntries();
+    void updateBlockMins();
+
+    // Throws when growing the pool from poolBytes by bytes would overflow the 32-bit entry offsets
+    void checkPoolSize(size_t poolBytes, size_t bytes) const;
+
+    // Returns [first, last) range of entries whose title starts with prefix
+    std::pair<size_t, size_t> prefixRange(std::string_view prefix) const;
+
+    // Picks up to limit entries from a range, shortest titles first, then by title
+    std::vector<const Entry*> pickShortest(std::pair<size_t, size_t> range, size_t limit) const;
+
+    std::string pool;               // all titles, back to back
+    std::vector<Entry> entries;     // sorted by title, then id
+    std::vector<uint32_t> blockMins; // shortest title length in each block of TITLE_BLOCK_ENTRIES entries
+    mutable std::shared_mutex mutex;
+};
@@ -0,0 +1,113 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    uint64_t startNs;
+    uint64_t endNs;
+};
+
+// Single-writer ring buffer owned by one thread
+struct ThreadBuffer {
+    uint32_t tid;
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> head{ 0 };    // total events written
+};
+
+std::mutex registryMutex;                               // only taken when a thread records its first span or exits
+std::vector<std::shared_ptr<ThreadBuffer>> registry;    // every buffer ever handed out, written by writeChromeJson
+std::vector<std::shared_ptr<ThreadBuffer>> freeBuffers; // buffers of exited threads, reused by new ones
+size_t capacity = 1 << 16;
+uint64_t originNs = 0;
+
+// Returns the buffer to the free list when its thread exits, so short-lived threads (one per query
+// with std::async) reuse a few buffers instead of adding one each. Spans already recorded stay in the ring.
+struct BufferLease {
+    std::shared_ptr<ThreadBuffer> buffer;
+
+    BufferLease()
+    {
+        std::lock_guard lock(registryMutex);
+        if (!freeBuffers.empty()) {
+            buffer = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+            return;
+        }
+
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->tid = static_cast<uint32_t>(registry.size() + 1);
+        buffer->events.resize(capacity);
+        registry.push_back(buffer);
+    }
+
+    ~BufferLease()
+    {
+        std::lock_guard lock(registryMutex);
+        freeBuffers.push_back(std::move(buffer));
+    }
+};
+
+ThreadBuffer& localBuffer()
+{
+    thread_local BufferLease lease;
+    return *lease.buffer;
+}
+
+} // namespace
+
+void Trace::enable(size_t eventsPerThread)
+{
+    {
+        std::lock_guard lock(registryMutex);
+        capacity = std::max<size_t>(eventsPerThread, 1);
+        originNs = nowNs();
+    }
+    enabledFlag.store(true, std::memory_order_relaxed);
+}
+
+void Trace::record(const char* name, uint64_t startNs, uint64_t endNs)
+{
+    ThreadBuffer& b = localBuffer();
+    uint64_t h = b.head.load(std::memory_order_relaxed);
+    b.events[h % b.events.size()] = { name, startNs, endNs };
+    b.head.store(h + 1, std::memory_order_release);
+}
+
+bool Trace::writeChromeJson(const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out) return false;
+
+    std::lock_guard lock(registryMutex);
+
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& b : registry) {
+        uint64_t h = b->head.load(std::memory_order_acquire);
+        uint64_t size = b->events.size();
+        uint64_t begin = h > size ? h - size : 0;
+
+        for (uint64_t i = begin; i < h; ++i) {
+            const TraceEvent& e = b->events[i % size];
+            if (!first) out << ",\n";
+            first = false;
+
+            // Chrome expects microseconds
+            out << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->tid
+                << ",\"ts\":" << (e.startNs - originNs) / 1000.0
+                << ",\"dur\":" << (e.endNs - e.startNs) / 1000.0 << "}";
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*
+Scoped span tracing written as Chrome trace-event JSON (open in chrome://tracing or ui.perfetto.dev).
+Each thread records into its own fixed-size ring buffer without locks, the oldest spans are overwritten when full.
+Buffers of exited threads are reused by new threads, so memory is bounded by the peak number of tracing threads.
+When tracing is disabled a span costs one relaxed atomic load.
+
+Usage: TRACE_SCOPE("VectorStorage::search"); names must be string literals.
+*/
+
+class Trace {
+public:
+    // Start recording, eventsPerThread is the ring buffer size of each thread
+    static void enable(size_t eventsPerThread = 1 << 16);
+
+    static bool enabled()
+    {
+        return enabledFlag.load(std::memory_order_relaxed);
+    }
+
+    // Write all recorded spans, call once traced work has finished
+    static bool writeChromeJson(const std::string& path);
+
+    static uint64_t nowNs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    static void record(const char* name, uint64_t startNs, uint64_t endNs);
+
+private:
+    static inline std::atomic<bool> enabledFlag{ false };
+};
+
+// Records a span from construction to destruction
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : name(Trace::enabled() ? name : nullptr),
+        start(this->name ? Trace::nowNs() : 0) {
+    }
+
+    ~TraceScope()
+    {
+        if (name) Trace::record(name, start, Trace::nowNs());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -1,34 +1,99 @@
 #include "VectorStorage.h"
+#include "AllocationCounter.h"
+#include "CorpusFile.h"
 #include "PageItem.h"
 #include "ONNXEmbedder.h"
+#include "EmbeddingProjection.h"
+#include "Reranker.h"
+#include "SearchSession.h"
+#include "TextUtils.h"
+#include "ThreadPool.h"
+#include "Trace.h"
 
 #include <pqxx/connection.hxx>
 #include <pqxx/transaction.hxx>
 #include <pqxx/result.hxx>
 #include <pqxx/field.hxx>
 
+#include <nlohmann/json.hpp>
+
 #include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory_resource>
 #include <cctype>
-#include <iomanip>
+#include <charconv>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <cmath>
 #include <chrono>
+#include <filesystem>
+#include <future>
+#include <iterator>
+#include <utility>
 
 // Constructor
-VectorStorage::VectorStorage(pqxx::connection& conn, size_t threadCount)
-    : conn(conn),
-    threadCount(threadCount),
-    client("localhost", 8000)
+VectorStorage::VectorStorage(ConnectionPool& pool, bool migrate)
+    : pool(pool),
+    sessions(std::make_unique<SearchSessionStore>(SESSION_TTL, SESSION_MEMORY_BYTES, SESSION_MAX_COUNT))
 {
-    client.set_connection_timeout(8);
-    client.set_read_timeout(8);
+    TRACE_SCOPE("VectorStorage::startup");
+    if (migrate) createSchema();
+    loadProjection();
+
+	// initialize ONNX embedder
+    embedder = std::make_unique<ONNXEmbedder>(
+        "./models/model.onnx",
+        "./models/vocab.txt",
+        EMBED_MAX_TOKENS
+    );
+
+	// Search is usable right away, title matches join in once the index is loaded
+    startupTask = std::async(std::launch::async, [this] {
+        try {
+            loadTitleIndex();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Could not load title index: " << e.what() << std::endl;
+        }
 
-    pqxx::work w(conn);
+        try {
+            TRACE_SCOPE("VectorStorage::warmUp");
+            auto ticket = embedScheduler.acquire(Priority::Low);
+            embedder->embedBatch({ "warm up" });    // first run allocates ORT arenas and faults in weights
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Embedder warm-up failed: " << e.what() << std::endl;
+        }
+    }).share();
+}
+
+VectorStorage::~VectorStorage() = default;
+
+bool VectorStorage::schemaIsCurrent(ConnectionPool& pool)
+{
+    auto conn = pool.acquire();
+    pqxx::work w(*conn);
+    pqxx::result r = w.exec("SELECT obj_description(to_regclass('vectors'), 'pg_class') AS stamp");
+    return !r.empty() && !r[0]["stamp"].is_null()
+        && r[0]["stamp"].as<std::string>() == "enginedb schema " + std::to_string(SCHEMA_VERSION);
+}
+
+// Create extension, types, table, indexes and functions if they don't exist, run by --migrate
+void VectorStorage::createSchema()
+{
+    auto conn = pool.acquire();
+    pqxx::work w(*conn);
 
 	// Create vector extension if it doesn't exist
     w.exec("CREATE EXTENSION IF NOT EXISTS vector;");
@@ -69,413 +134,1336 @@ VectorStorage::VectorStorage(pqxx::connection& conn, size_t threadCount)
         USING hnsw (embedding vector_cosine_ops);
     )");
 
-    w.exec("SET hnsw.ef_search = 64");
-    w.commit();
+	// Article metadata for filtered search, added in schema 2 so existing tables are altered in place
+    w.exec(R"(
+        ALTER TABLE vectors
+            ADD COLUMN IF NOT EXISTS ns INT NOT NULL DEFAULT 0,
+            ADD COLUMN IF NOT EXISTS article_length INT,
+            ADD COLUMN IF NOT EXISTS updated_at TIMESTAMPTZ,
+            ADD COLUMN IF NOT EXISTS categories TEXT[];
+    )");
 
-	// initialize ONNX embedder
-    embedder = std::make_unique<ONNXEmbedder>(
-        "./models/model.onnx",
-        "./models/vocab.txt",
-        128
-    );
+	// Filter indexes, the planner uses them to estimate selectivity and for the exact prefilter path
+    w.exec("CREATE INDEX IF NOT EXISTS idx_vectors_ns ON vectors (ns);");
+    w.exec("CREATE INDEX IF NOT EXISTS idx_vectors_updated_at ON vectors (updated_at);");
+    w.exec("CREATE INDEX IF NOT EXISTS idx_vectors_article_length ON vectors (article_length);");
+    w.exec("CREATE INDEX IF NOT EXISTS idx_vectors_categories ON vectors USING gin (categories);");
+
+	// Learned projections for the reduced-dimension mode, latest row is active
+    w.exec(R"(
+        CREATE TABLE IF NOT EXISTS projections (
+            id SERIAL PRIMARY KEY,
+            in_dim INT NOT NULL,
+            out_dim INT NOT NULL,
+            mean REAL[] NOT NULL,
+            components REAL[] NOT NULL,
+            explained_variance DOUBLE PRECISION,
+            created_at TIMESTAMPTZ DEFAULT now()
+        );
+    )");
+
+	// Hybrid scoring in SQL, mirrors rerankScore in Reranker.cpp
+	// Token hashes come from the client since std::hash can't be computed in SQL
+    w.exec(R"(
+        CREATE OR REPLACE FUNCTION hybrid_rank(
+            query_vec vector,
+            candidate_ids BIGINT[],
+            query_hashes BIGINT[],
+            query_tokens TEXT[],
+            clean_query TEXT,
+            knn_weight REAL,
+            keyword_weight REAL,
+            title_weight REAL,
+            top_k INT
+        )
+        RETURNS TABLE (id INT, score REAL, title TEXT, description TEXT, link TEXT)
+        LANGUAGE sql STABLE PARALLEL SAFE
+        AS $$
+            SELECT v.id, s.score::REAL, v.title, v.description, v.link
+            FROM vectors v
+            CROSS JOIN LATERAL (
+                SELECT
+                    (1.0 / (1.0 + (v.embedding <=> query_vec))) * knn_weight
+                    + CASE WHEN cardinality(query_hashes) > 0 THEN
+                        COALESCE((
+                            SELECT sum(ln((1 + t.freq)::DOUBLE PRECISION))
+                            FROM unnest(v.token_stats) t
+                            WHERE t.hash = ANY(query_hashes)
+                        ), 0) / cardinality(query_hashes)
+                      ELSE 0 END * keyword_weight
+                    + CASE WHEN v.title = clean_query THEN 2.5
+                      ELSE
+                        CASE WHEN strpos(v.title, clean_query) > 0 THEN 1.5 ELSE 0 END
+                        + CASE WHEN cardinality(query_tokens) > 0 THEN (
+                            SELECT count(*) FROM unnest(query_tokens) q WHERE strpos(v.title, q) > 0
+                          )::DOUBLE PRECISION / cardinality(query_tokens)
+                          ELSE 0 END
+                      END * title_weight AS score
+            ) s
+            WHERE v.id = ANY(candidate_ids)
+            ORDER BY s.score DESC
+            LIMIT top_k
+        $$;
+    )");
+
+	// Stamp the version so normal starts can skip all of the above
+    w.exec("COMMENT ON TABLE vectors IS 'enginedb schema " + std::to_string(SCHEMA_VERSION) + "'");
+
+    w.commit();
 }
 
-// Ingest batch of data into DB
-void VectorStorage::ingestBatch(const std::vector<PageItem>& pages) 
+// Ingest batch of data into DB, pages stay views into the batch's buffers all the way to the COPY stream
+void VectorStorage::ingestBatch(ArticleBatch batch)
 {
+    std::vector<PageItem>& pages = batch.pages;
     if (pages.empty()) return;
+    TRACE_SCOPE("VectorStorage::ingestBatch");
 
-    std::vector<std::string> texts;
+    std::shared_future<void>(startupTask).wait();     // the title index must be loaded before it is extended
+
+    std::vector<std::string_view> texts;
     texts.reserve(pages.size());
     for (const auto& p : pages) {
         texts.push_back(p.text);
     }
 
-    std::vector<std::vector<float>> embeddings = embedBatch(texts);
+    EmbeddingMatrix embeddings = embedBatch(texts);
 
-    if (embeddings.empty()) {
+    if (embeddings.rows() != pages.size()) {
         std::cerr << "Embedding failed for entire batch, skipping.\n";
         return;
     }
 
-    // Filter out failed embeddings
-    std::vector<PageItem> validPages;
-    std::vector<std::vector<float>> validEmbeddings;
-    for (size_t i = 0; i < embeddings.size(); ++i) {
-        if (!embeddings[i].empty()) {
-            validPages.push_back(pages[i]);
-            validEmbeddings.push_back(std::move(embeddings[i]));
-        }
-        else {
+    // Compact failed embeddings away, pages and matrix rows move together
+    size_t kept = 0;
+    for (size_t i = 0; i < pages.size(); ++i) {
+        if (!embeddings.valid[i]) {
             std::cerr << "Skipping article due to embedding failure: " << pages[i].title << "\n";
+            continue;
         }
+        if (kept != i) {
+            pages[kept] = pages[i];
+            std::copy_n(embeddings.row(i), embeddings.dim, embeddings.row(kept));
+        }
+        kept++;
+    }
+    pages.resize(kept);
+    embeddings.truncate(kept);
+    if (pages.empty()) return;
+
+    std::vector<int64_t> ids = insertBatch(pages, embeddings);
+
+    // Keep title index in sync with the rows just inserted
+    std::vector<std::pair<std::string, int64_t>> titles;
+    titles.reserve(ids.size());
+    for (size_t i = 0; i < ids.size() && i < pages.size(); ++i) {
+        titles.emplace_back(cleanString(pages[i].title), ids[i]);
+    }
+    try {
+        titleIndex.insert(titles);
+    }
+    catch (const std::length_error& e) {
+        std::cerr << "Title index not updated: " << e.what() << "\n";
     }
-    if (validPages.empty()) return;
+}
+
+// Load all stored titles into the in-memory title index
+void VectorStorage::loadTitleIndex()
+{
+    auto conn = pool.acquire();
+    pqxx::work w(*conn);
+    pqxx::result r = w.exec("SELECT id, title FROM vectors WHERE title IS NOT NULL");
+    w.commit();
+
+    std::vector<std::pair<std::string, int64_t>> titles;
+    titles.reserve(r.size());
+    for (auto const& row : r) {
+        // titles are stored already normalized by cleanString
+        titles.emplace_back(row["title"].as<std::string>(), row["id"].as<int64_t>());
+    }
+
+    titleIndex.build(std::move(titles));
+}
 
-    std::vector<int64_t> ids = insertBatch(validPages, validEmbeddings);
+// Prefix autocomplete over article titles
+std::vector<TitleMatch> VectorStorage::suggestTitles(const std::string& prefix, size_t limit)
+{
+    return titleIndex.suggest(cleanString(prefix), limit);
+}
+
+// Load the latest projection if the reduced column has been built
+void VectorStorage::loadProjection()
+{
+    auto conn = pool.acquire();
+    pqxx::work w(*conn);
+
+    pqxx::result column = w.exec(
+        "SELECT 1 FROM information_schema.columns "
+        "WHERE table_name = 'vectors' AND column_name = 'embedding_reduced'");
+    if (column.empty()) return;
+
+    pqxx::result r = w.exec(
+        "SELECT in_dim, out_dim, mean::text AS mean, components::text AS components "
+        "FROM projections ORDER BY id DESC LIMIT 1");
+    w.commit();
+    if (r.empty()) return;
+
+    auto row = r[0];
+    auto loaded = std::make_shared<const EmbeddingProjection>(
+        row["in_dim"].as<size_t>(),
+        row["out_dim"].as<size_t>(),
+        parseFloatList(row["mean"].view()),
+        parseFloatList(row["components"].view())
+    );
+
+    std::lock_guard lock(projectionMutex);
+    projection = std::move(loaded);
+}
+
+std::shared_ptr<const EmbeddingProjection> VectorStorage::currentProjection() const
+{
+    std::lock_guard lock(projectionMutex);
+    return projection;
+}
+
+bool VectorStorage::hasProjection() const
+{
+    return currentProjection() != nullptr;
+}
+
+std::shared_ptr<const FlatIndex> VectorStorage::currentFlatIndex() const
+{
+    std::lock_guard lock(flatIndexMutex);
+    return flatIndex;
 }
 
-// DB insert
+bool VectorStorage::hasFlatIndex() const
+{
+    return currentFlatIndex() != nullptr;
+}
+
+RankStats VectorStorage::rankStats() const
+{
+    RankStats stats;
+    stats.candidates = rankedCandidates.load();
+    stats.allocations = rankAllocations.load();
+    return stats;
+}
+
+// Stream embeddings in id order into a new version of the flat index file, then swap it in
+// Every export gets its own file, searches still scanning the previous version keep their mapping
+size_t VectorStorage::exportFlatIndex(const std::string& path, FlatElement element)
+{
+    TRACE_SCOPE("VectorStorage::exportFlatIndex");
+    std::filesystem::path base(path);
+    auto version = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::filesystem::path versionPath = base.parent_path()
+        / (base.stem().string() + "." + std::to_string(version) + base.extension().string());
+    std::string tmpPath = versionPath.string() + ".tmp";     // never picked up by loadFlatIndex while half written
+    FlatIndexWriter writer(tmpPath, DIM, element);
+
+    int64_t lastId = 0;
+    while (true) {
+        auto conn = pool.acquire(Priority::Low);
+        pqxx::work w(*conn);
+
+        pqxx::params p;
+        p.append(lastId);
+        p.append(FLAT_EXPORT_BATCH);
+        pqxx::result r = w.exec(
+            "SELECT id, embedding::text AS embedding FROM vectors "
+            "WHERE id > $1 AND embedding IS NOT NULL "
+            "ORDER BY id LIMIT $2", p);
+        if (r.empty()) break;
+
+        for (auto const& row : r) {
+            lastId = row["id"].as<int64_t>();
+            writer.add(lastId, parseFloatList(row["embedding"].view()));
+        }
+    }
+    writer.finish();
+
+    std::filesystem::rename(tmpPath, versionPath);
+    loadFlatIndex(path);
+    return writer.size();
+}
+
+// Versions of a flat index are stored next to path as stem.<version>.extension, the newest is loaded
+// The unversioned path is the fallback for a file exported by hand
+bool VectorStorage::loadFlatIndex(const std::string& path)
+{
+    std::filesystem::path base(path);
+    std::filesystem::path dir = base.has_parent_path() ? base.parent_path() : std::filesystem::path(".");
+    std::string prefix = base.stem().string() + ".";
+    std::string extension = base.extension().string();
+
+    std::vector<std::pair<long long, std::filesystem::path>> versions;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= prefix.size() + extension.size() || name.compare(0, prefix.size(), prefix) != 0
+            || name.compare(name.size() - extension.size(), extension.size(), extension) != 0) continue;
+
+        std::string_view digits(name.data() + prefix.size(), name.size() - prefix.size() - extension.size());
+        long long version = 0;
+        auto res = std::from_chars(digits.data(), digits.data() + digits.size(), version);
+        if (res.ec == std::errc() && res.ptr == digits.data() + digits.size()) versions.emplace_back(version, entry.path());
+    }
+    std::sort(versions.begin(), versions.end());
+
+    std::filesystem::path latest;
+    if (!versions.empty()) latest = versions.back().second;
+    else if (std::filesystem::exists(base)) latest = base;
+    else return false;
+
+    auto loaded = std::make_shared<const FlatIndex>(latest.string());
+    if (loaded->dim() != DIM) {
+        throw std::runtime_error("Flat index has " + std::to_string(loaded->dim()) + " dimensions, expected " + std::to_string(DIM));
+    }
+
+    {
+        std::lock_guard lock(flatIndexMutex);
+        flatIndex = std::move(loaded);
+    }
+
+	// Older versions go once nothing maps them, POSIX allows unlinking a mapped file,
+	// on Windows the removal fails while a search still holds the old version and is retried on the next load
+    for (const auto& [version, file] : versions) {
+        if (file != latest) std::filesystem::remove(file, ec);
+    }
+    return true;
+}
+
+// Learn a projection from a sample, store it, backfill the reduced column and index it
+ProjectionReport VectorStorage::buildProjection(size_t outDim, size_t sampleSize, size_t evalQueries)
+{
+    ProjectionReport report;
+    report.outDim = outDim;
+
+	// Sample stored embeddings
+    std::vector<std::vector<float>> samples;
+    {
+        auto conn = pool.acquire();
+        pqxx::work w(*conn);
+        pqxx::params p;
+        p.append(sampleSize);
+        pqxx::result r = w.exec(
+            "SELECT embedding::text AS embedding FROM vectors "
+            "WHERE embedding IS NOT NULL ORDER BY random() LIMIT $1", p);
+
+        samples.reserve(r.size());
+        for (auto const& row : r) {
+            samples.push_back(parseFloatList(row["embedding"].view()));
+        }
+    }
+    report.samples = samples.size();
+
+    auto learned = std::make_shared<const EmbeddingProjection>(
+        EmbeddingProjection::learn(samples, outDim));
+    report.explainedVariance = learned->getExplainedVariance();
+    samples.clear();
+
+	// Store projection and recreate the reduced column with the new dimension
+	// In-flight inserts finish first and later ones see the new projection, so no row is written with the old dimension
+    {
+        std::unique_lock swapLock(projectionSwap);
+        auto conn = pool.acquire();
+        pqxx::work w(*conn);
+
+        pqxx::params p;
+        p.append(learned->inputDim());
+        p.append(learned->outputDim());
+        p.append(learned->getMean());
+        p.append(learned->getComponents());
+        p.append(learned->getExplainedVariance());
+        w.exec(
+            "INSERT INTO projections (in_dim, out_dim, mean, components, explained_variance) "
+            "VALUES ($1, $2, $3, $4, $5)", p);
+
+        w.exec("DROP INDEX IF EXISTS idx_vectors_embedding_reduced_hnsw");
+        w.exec("ALTER TABLE vectors DROP COLUMN IF EXISTS embedding_reduced");
+        w.exec("ALTER TABLE vectors ADD COLUMN embedding_reduced vector(" + std::to_string(outDim) + ")");
+        w.commit();
+
+		// New inserts write the reduced column from here on
+        std::lock_guard lock(projectionMutex);
+        projection = learned;
+    }
+
+	// Backfill existing rows in id order
+    int64_t lastId = 0;
+    while (true) {
+        auto conn = pool.acquire(Priority::Low);
+        pqxx::work w(*conn);
+
+        pqxx::params p;
+        p.append(lastId);
+        p.append(PROJECTION_BATCH);
+        pqxx::result r = w.exec(
+            "SELECT id, embedding::text AS embedding FROM vectors "
+            "WHERE id > $1 AND embedding_reduced IS NULL AND embedding IS NOT NULL "
+            "ORDER BY id LIMIT $2", p);
+        if (r.empty()) break;
+
+        std::ostringstream sql;
+        sql << "UPDATE vectors SET embedding_reduced = v.e::vector FROM (VALUES ";
+        for (size_t i = 0; i < r.size(); ++i) {
+            if (i > 0) sql << ", ";
+            int64_t id = r[i]["id"].as<int64_t>();
+            std::vector<float> reduced = learned->project(parseFloatList(r[i]["embedding"].view()));
+            sql << "(" << id << ", " << w.quote(VectorToPGVector(reduced)) << ")";
+            lastId = id;
+        }
+        sql << ") AS v(id, e) WHERE vectors.id = v.id";
+        w.exec(sql.str());
+        w.commit();
+
+        report.rowsProjected += r.size();
+        std::cout << "Projected " << report.rowsProjected << " rows\n";
+    }
+
+	// Index built after the backfill, much faster than maintaining it row by row
+    {
+        auto conn = pool.acquire();
+        pqxx::work w(*conn);
+        w.exec(R"(
+            CREATE INDEX IF NOT EXISTS idx_vectors_embedding_reduced_hnsw
+            ON vectors
+            USING hnsw (embedding_reduced vector_cosine_ops);
+        )");
+        w.commit();
+    }
+
+    report.recallAtK = projectionRecall(*learned, evalQueries, report.k);
+    return report;
+}
+
+// Recall of exact top-k over reduced vectors against exact top-k over full vectors, stored rows used as queries
+double VectorStorage::projectionRecall(const EmbeddingProjection& proj, size_t evalQueries, size_t k)
+{
+    auto conn = pool.acquire();
+    pqxx::work w(*conn);
+    w.exec("SET LOCAL enable_indexscan = off");
+
+    pqxx::params sp;
+    sp.append(evalQueries);
+    pqxx::result queries = w.exec(
+        "SELECT id, embedding::text AS embedding FROM vectors "
+        "WHERE embedding IS NOT NULL ORDER BY random() LIMIT $1", sp);
+
+    double total = 0.0;
+    size_t counted = 0;
+
+    for (auto const& q : queries) {
+        int64_t qid = q["id"].as<int64_t>();
+        std::vector<float> full = parseFloatList(q["embedding"].view());
+
+        pqxx::params fp;
+        fp.append(VectorToPGVector(full));
+        fp.append(qid);
+        fp.append(k);
+        pqxx::result expected = w.exec(
+            "SELECT id FROM vectors WHERE id <> $2 "
+            "ORDER BY embedding <=> $1::vector LIMIT $3", fp);
+
+        pqxx::params rp;
+        rp.append(VectorToPGVector(proj.project(full)));
+        rp.append(qid);
+        rp.append(k);
+        pqxx::result actual = w.exec(
+            "SELECT id FROM vectors WHERE id <> $2 "
+            "ORDER BY embedding_reduced <=> $1::vector LIMIT $3", rp);
+
+        if (expected.empty()) continue;
+
+        std::unordered_set<int64_t> expectedIds;
+        for (auto const& row : expected) expectedIds.insert(row["id"].as<int64_t>());
+
+        size_t hits = 0;
+        for (auto const& row : actual) hits += expectedIds.count(row["id"].as<int64_t>());
+
+        total += static_cast<double>(hits) / static_cast<double>(expectedIds.size());
+        counted++;
+    }
+
+    return counted ? total / counted : 0.0;
+}
+
+// DB insert, rows are streamed with COPY so article text is escaped once into the stream instead of into a giant INSERT
 std::vector<int64_t> VectorStorage::insertBatch(
     const std::vector<PageItem>& pages,
-    const std::vector<std::vector<float>>& embeddings)
+    const EmbeddingMatrix& embeddings)
 {
-    pqxx::work w(conn);
-    std::ostringstream sql;
-    sql << "INSERT INTO vectors (title, description, link, embedding, token_stats) VALUES ";
+    TRACE_SCOPE("VectorStorage::insertBatch");
+    std::shared_lock swapLock(projectionSwap);     // held until the COPY commits, see buildProjection
+    auto proj = currentProjection();
+
+	// Tokenizing and formatting vectors is the CPU heavy part, done on the shared pool
+    struct RowLiterals {
+        std::string title;
+        std::string link;
+        std::string tokenStats;
+        std::string embedding;
+        std::string reduced;
+        std::string categories;
+    };
+    std::vector<RowLiterals> literals(pages.size());
+    ThreadPool::shared().parallelFor(0, pages.size(), 8, [&](size_t i) {
+        const PageItem& page = pages[i];
+        const float* embedding = embeddings.row(i);
+
+        literals[i].title = cleanString(page.title);
+        literals[i].link.append(WIKI_LINK_PREFIX).append(page.title);
+        literals[i].tokenStats = page.tokenStats.empty()
+            ? buildTokenStatArray(computeTokenStats(page.text))
+            : buildTokenStatArray(decodeTokenStats(page.tokenStats));
+        literals[i].embedding = VectorToPGVector(embedding, embeddings.dim);
+        if (proj) {
+            std::vector<float> reduced = proj->project(embedding, embeddings.dim);
+            literals[i].reduced = VectorToPGVector(reduced);
+        }
+        literals[i].categories = buildTextArray(page.meta.categories);
+    });
 
-    for (size_t i = 0; i < pages.size(); ++i) {
-        if (i > 0) sql << ", ";
+    auto conn = pool.acquire(Priority::Low);
+    pqxx::work w(*conn);
 
-        auto tokenFreq = tokenizeWithFrequency(pages[i].text);
-        std::string tokenStatArray = buildTokenStatArray(tokenFreq);
+	// COPY can't return ids, so they are drawn from the sequence first
+    std::vector<int64_t> ids;
+    ids.reserve(pages.size());
+    {
+        pqxx::params p;
+        p.append(pages.size());
+        pqxx::result r = w.exec(
+            "SELECT nextval(pg_get_serial_sequence('vectors', 'id')) AS id FROM generate_series(1, $1)", p);
+        for (auto const& row : r) ids.push_back(row["id"].as<int64_t>());
+    }
 
-        sql << "("
-            << w.quote(cleanString(pages[i].title)) << ", "
-            << w.quote(pages[i].text) << ", "
-            << w.quote(pages[i].link) << ", "
-            << w.quote(VectorToPGVector(embeddings[i])) << "::vector, "
-            << tokenStatArray
-            << ")";
+    {
+        TRACE_SCOPE("VectorStorage::insertBatch.copy");
+        auto stream = proj
+            ? pqxx::stream_to::table(w, { "vectors" },
+                { "id", "title", "description", "link", "embedding", "token_stats",
+                  "ns", "article_length", "updated_at", "categories", "embedding_reduced" })
+            : pqxx::stream_to::table(w, { "vectors" },
+                { "id", "title", "description", "link", "embedding", "token_stats",
+                  "ns", "article_length", "updated_at", "categories" });
+
+        for (size_t i = 0; i < pages.size(); ++i) {
+            const RowLiterals& row = literals[i];
+            const ArticleMeta& meta = pages[i].meta;
+
+            // Unknown length and timestamp go in as NULL so filters on them skip the row
+            std::optional<int32_t> length;
+            if (meta.length > 0) length = meta.length;
+            std::optional<std::string_view> updatedAt;
+            if (!meta.timestamp.empty()) updatedAt = meta.timestamp;
+
+            if (proj) {
+                stream.write_values(ids[i], row.title, pages[i].text, row.link, row.embedding, row.tokenStats,
+                    meta.ns, length, updatedAt, row.categories, row.reduced);
+            }
+            else {
+                stream.write_values(ids[i], row.title, pages[i].text, row.link, row.embedding, row.tokenStats,
+                    meta.ns, length, updatedAt, row.categories);
+            }
+        }
+        stream.complete();
+        w.commit();
     }
-    sql << " RETURNING id";
-    pqxx::result r = w.exec(sql.str());
-    w.commit();
 
-    std::vector<int64_t> ids;
-    for (auto const& row : r) ids.push_back(row["id"].as<int64_t>());
     return ids;
 }
 
-// Embedding batch of texts using ONNX embedder
-std::vector<std::vector<float>> VectorStorage::embedBatch(const std::vector<std::string>& texts) {
-    return embedder->embedBatch(texts);
+// Embedding batch of texts, on the worker fleet if configured, otherwise with the local ONNX embedder
+EmbeddingMatrix VectorStorage::embedBatch(const std::vector<std::string_view>& texts) {
+    TRACE_SCOPE("VectorStorage::embedBatch");
+    if (dispatcher) return dispatcher->embedBatch(texts, DIM);
+
+	// Small low priority chunks so a query never waits behind a whole ingest batch, each chunk is written into its rows
+    EmbeddingMatrix result(texts.size(), DIM);
+    for (size_t start = 0; start < texts.size(); start += INGEST_EMBED_CHUNK) {
+        size_t end = std::min(start + INGEST_EMBED_CHUNK, texts.size());
+        std::vector<std::string_view> chunk(texts.begin() + start, texts.begin() + end);
+
+        auto ticket = embedScheduler.acquire(Priority::Low);
+        embedder->embedBatch(chunk, result, start);
+    }
+    return result;
+}
+
+void VectorStorage::setEmbeddingWorkers(const std::vector<std::string>& endpoints)
+{
+    dispatcher = endpoints.empty() ? nullptr : std::make_unique<EmbeddingDispatcher>(endpoints);
 }
 
 // Embedding single text
 std::vector<float> VectorStorage::EmbedText(const std::string& text) {
-    return embedder->embedBatch({ text })[0];
+    TRACE_SCOPE("VectorStorage::EmbedText");
+    auto ticket = embedScheduler.acquire(Priority::High);
+    EmbeddingMatrix embedding = embedder->embedBatch({ std::string_view(text) });
+    return std::vector<float>(embedding.row(0), embedding.row(0) + embedding.dim);
 }
 
-// Public search API - performs vector search + token matching + title heuristics
+void VectorStorage::setIngestCpuShare(double share)
+{
+    embedScheduler.setLowCpuShare(share);
+}
+
+const SearchConfig& VectorStorage::getSearchConfig() const
+{
+    return searchConfig;
+}
+
+void VectorStorage::setSearchConfig(const SearchConfig& config)
+{
+    searchConfig = config;
+}
+
+// Public search API using the current search config
 std::vector<SearchResult> VectorStorage::search(
     const std::string& query,
     size_t topK)
 {
-    std::string cleanQuery = cleanString(query);
-    std::unordered_set<std::string> queryTokens = tokenizeText(cleanQuery);
+    return search(query, topK, searchConfig);
+}
 
-    std::vector<int64_t> queryHashVec = hashTokens(queryTokens);
+// Public search API - performs vector search + token matching + title heuristics
+std::vector<SearchResult> VectorStorage::search(
+    const std::string& query,
+    size_t topK,
+    const SearchConfig& config,
+    const SearchFilter& filter)
+{
+    TRACE_SCOPE("VectorStorage::search");
 
-    std::unordered_set<int64_t> queryHashes(
-        queryHashVec.begin(),
-        queryHashVec.end()
-    );
+	// Per-request arena for query features and the best scored rows, no heap use for typical queries
+    std::array<std::byte, SEARCH_ARENA_BYTES> arenaBuffer;
+    std::pmr::monotonic_buffer_resource arena(arenaBuffer.data(), arenaBuffer.size());
+
+    QueryFeatures features(&arena);
+    buildQueryFeatures(query, features);
+    std::string_view cleanQuery = features.cleanQuery;
 
     std::string entityQuery = extractEntity(query);
+    bool filtered = !filter.empty();
+
+	// Connection checkout, transaction setup, filter planning and title lookups run while the query is embedded
+	// The future's destructor joins it on every early return below
+    auto prepared = prepareQuery(cleanQuery, entityQuery, config, filter, config.efSearch);
 
     auto queryEmbedding = EmbedText(entityQuery);
     if (queryEmbedding.empty()) return {};
 
     std::string queryVec = VectorToPGVector(queryEmbedding);
-    size_t expandedK = std::max(topK, static_cast<size_t>(topK * 1.5));
 
-    pqxx::work w(conn);
-    std::ostringstream sql;
+	// Reduced mode runs the ANN stage on projected vectors, rerank still uses the full embedding
+    auto proj = config.useReduced ? currentProjection() : nullptr;
+    std::string annColumn = proj ? "embedding_reduced" : "embedding";
+    std::string annVec = proj ? VectorToPGVector(proj->project(queryEmbedding)) : queryVec;
 
-    sql <<
-        "SELECT id "
-        "FROM vectors "
-        "ORDER BY embedding <=> $1::vector "
-        "LIMIT $2";
+    size_t expandedK = std::max(topK, static_cast<size_t>(topK * config.expandFactor));
 
-    pqxx::params p1;
-    p1.append(queryVec);
-    p1.append(expandedK);
+	// Flat mode takes candidates from the exact in-memory scan, Postgres only serves rows
+	// The flat index has no metadata, filtered queries always go to pgvector
+    auto flat = config.useFlatIndex && !filtered ? currentFlatIndex() : nullptr;
+    std::vector<int64_t> flatIds;
+    if (flat) {
+        for (const auto& hit : flat->search(queryEmbedding, expandedK)) flatIds.push_back(hit.id);
+    }
+
+    PreparedQuery ready = prepared.get();
+    pqxx::work& w = *ready.w;
+
+    if (config.serverRerank) {
+        std::vector<int64_t> extraIds = std::move(ready.titleIds);
+        if (flat) extraIds.insert(extraIds.begin(), flatIds.begin(), flatIds.end());
 
-    pqxx::result r = w.exec(sql.str(), p1);
-    if (r.empty()) return {};
+        auto results = searchInDatabase(w, features, extraIds,
+            queryVec, annColumn, annVec, flat ? 0 : expandedK, topK, config, filter);
+
+		// A capped iterative scan can come back short when the estimate was off, the exact prefilter fills the page
+        if (filtered && !ready.plan.exact && results.size() < topK) {
+            w.exec("SET LOCAL enable_indexscan = off");
+            results = searchInDatabase(w, features, extraIds,
+                queryVec, annColumn, annVec, expandedK, topK, config, filter);
+        }
+        return results;
+    }
 
 	// get all fields for the top results to compute final scores
-    std::vector<int64_t> topIds;
-    topIds.reserve(r.size());
-    for (auto const& row : r) {
-        topIds.push_back(row["id"].as<int64_t>());
+    std::vector<int64_t> topIds = flat
+        ? std::move(flatIds)
+        : annCandidates(w, annColumn, annVec, expandedK, filter, ready.plan, {});
+
+	// Inject exact and prefix title matches, ANN may not have returned them, even when it returned nothing
+    for (int64_t id : ready.titleIds) {
+        if (std::find(topIds.begin(), topIds.end(), id) == topIds.end())
+            topIds.push_back(id);
     }
+    if (topIds.empty()) return {};
+
+    return rankCandidates(w, features, queryVec, topIds, topK, config, &arena);
+}
+
+// Only reads the features from the other thread, the caller's arena isn't touched until the future is joined
+std::future<VectorStorage::PreparedQuery> VectorStorage::prepareQuery(
+    std::string_view cleanQuery,
+    std::string_view entityQuery,
+    const SearchConfig& config,
+    const SearchFilter& filter,
+    size_t efSearch)
+{
+    return std::async(std::launch::async, [this, cleanQuery, entityQuery, &config, &filter, efSearch] {
+        TRACE_SCOPE("VectorStorage::search.prepare");
+        auto conn = pool.acquire();
+        auto w = std::make_unique<pqxx::work>(*conn);
+
+        FilterPlan plan = setupScan(*w, config, filter, efSearch);
+        std::vector<int64_t> titleIds = filterIds(*w, titleCandidates(cleanQuery, entityQuery), filter);
+        return PreparedQuery{ std::move(conn), std::move(w), plan, std::move(titleIds) };
+    });
+}
+
+VectorStorage::FilterPlan VectorStorage::setupScan(
+    pqxx::work& w,
+    const SearchConfig& config,
+    const SearchFilter& filter,
+    size_t efSearch)
+{
+	// Exact mode disables index scans so Postgres falls back to a full cosine scan
+    FilterPlan plan;
+    plan.exact = config.exact;
+    if (config.exact) {
+        w.exec("SET LOCAL enable_indexscan = off");
+        return plan;
+    }
+
+	// ef_search caps how many rows a plain HNSW scan returns, past pgvector's limit annCandidates scans iteratively
+    w.exec("SET LOCAL hnsw.ef_search = " + std::to_string(std::min(efSearch, HNSW_MAX_EF_SEARCH)));
+    if (!filter.empty()) plan = planFilteredScan(w, filter);
+    return plan;
+}
+
+// Client side: stream the candidate rows and score each one as it arrives, only rows that make the top limit are copied
+std::vector<SearchResult> VectorStorage::rankCandidates(
+    pqxx::work& w,
+    const QueryFeatures& features,
+    const std::string& queryVec,
+    const std::vector<int64_t>& ids,
+    size_t limit,
+    const SearchConfig& config,
+    std::pmr::memory_resource* arena)
+{
+    if (ids.empty() || limit == 0) return {};
+    if (config.serverRerank) {
+        return searchInDatabase(w, features, ids, queryVec, "embedding", queryVec, 0, limit, config, SearchFilter{});
+    }
+
+	// COPY takes no parameters, the ids and the query vector go in as literals
+    std::string idArray = IdsToPGArray(ids);
 
     std::ostringstream detailSql;
     detailSql <<
         "SELECT id, title, description, link, "
-        "token_stats::text AS token_stats, "
-        "1.0 / (1.0 + (embedding <=> $1::vector)) AS knn_score "
+        "COALESCE(token_stats::text, '') AS token_stats, "
+        "(1.0 / (1.0 + (embedding <=> " << w.quote(queryVec) << "::vector)))::REAL AS knn_score "
         "FROM vectors "
-        "WHERE id = ANY($2)";
-
-    pqxx::params p2;
-    p2.append(queryVec);
-    p2.append(topIds);
-
-    pqxx::result detailedResults = w.exec(detailSql.str(), p2);
+        "WHERE id = ANY(" << w.quote(idArray) << "::BIGINT[])";
 
-	std::vector<SearchResult> results;
-    results.reserve(r.size());
-
-	// Combine KNN score with token overlap and title heuristics for final scoring
-    for (auto const& row : detailedResults) {
-        float knnScore = row["knn_score"].as<float>();
+	// Min-heap of the best rows so far, a row is scored from the stream's views and copied only if it gets in
+    auto better = [](const SearchResult& a, const SearchResult& b) {
+        return a.score > b.score;
+    };
+    std::pmr::vector<SearchResult> best(arena);
+    best.reserve(std::min(limit, ids.size()));
+
+	// Allocations are counted on this thread from the first row to the last, rows that miss the top limit should add none
+    uint64_t candidates = 0;
+    uint64_t allocationsBefore = AllocationCounter::threadAllocations();
+    {
+        TRACE_SCOPE("VectorStorage::search.detailStream");
+        auto stream = pqxx::stream_from::query(w, detailSql.str());
+        for (auto [id, title, description, link, tokenStats, knnScore] : stream.iter<
+            int64_t, std::string_view, std::string_view, std::string_view, std::string_view, float>()) {
+            ++candidates;
+            float score = rerankScore(features, config, knnScore, title, tokenStats);
+
+            if (best.size() == limit) {
+                if (score <= best.front().score) continue;
+                std::pop_heap(best.begin(), best.end(), better);
+                best.pop_back();
+            }
+            best.push_back({ id, score, std::string(title), std::string(description), std::string(link) });
+            std::push_heap(best.begin(), best.end(), better);
+        }
+        stream.complete();
+    }
+    rankAllocations += AllocationCounter::threadAllocations() - allocationsBefore;
+    rankedCandidates += candidates;
 
-        auto freqs = parseTokenStats(row["token_stats"]);
-        float keyword = keywordScore(queryHashes, freqs);
+    std::sort_heap(best.begin(), best.end(), better);    // best first
+    return std::vector<SearchResult>(
+        std::make_move_iterator(best.begin()),
+        std::make_move_iterator(best.end()));
+}
 
-        std::string title = row["title"].as<std::string>();
-        std::string cleanTitle = cleanString(title);
+// Like rankCandidates but keeps every candidate and only its score, description and link aren't read
+std::vector<ScoredId> VectorStorage::scoreCandidates(
+    pqxx::work& w,
+    const QueryFeatures& features,
+    const std::string& queryVec,
+    const std::vector<int64_t>& ids,
+    const SearchConfig& config)
+{
+    if (ids.empty()) return {};
+
+    std::vector<ScoredId> scored;
+    scored.reserve(ids.size());
+	// hybrid_rank is a plain SQL function and gets inlined, so columns not selected here aren't read either
+    if (config.serverRerank) {
+        pqxx::params p;
+        p.append(queryVec);
+        p.append(ids);
+        p.append(std::vector<int64_t>(features.hashes.begin(), features.hashes.end()));
+        p.append(std::vector<std::string>(features.tokens.begin(), features.tokens.end()));
+        p.append(std::string(features.cleanQuery));
+        p.append(config.knnWeight);
+        p.append(config.keywordWeight);
+        p.append(config.titleWeight);
+        p.append(static_cast<int>(ids.size()));
+
+        pqxx::result r = w.exec(
+            "SELECT id, score "
+            "FROM hybrid_rank($1::vector, $2::BIGINT[], $3::BIGINT[], $4::TEXT[], $5, $6, $7, $8, $9)", p);
+        for (auto const& row : r) {
+            scored.push_back({ row["id"].as<int64_t>(), row["score"].as<float>() });
+        }
+        return scored;
+    }
 
-        std::unordered_set<std::string> titleTokens = tokenizeText(cleanString(title));
+    std::ostringstream scoreSql;
+    scoreSql <<
+        "SELECT id, title, "
+        "COALESCE(token_stats::text, '') AS token_stats, "
+        "(1.0 / (1.0 + (embedding <=> " << w.quote(queryVec) << "::vector)))::REAL AS knn_score "
+        "FROM vectors "
+        "WHERE id = ANY(" << w.quote(IdsToPGArray(ids)) << "::BIGINT[])";
+
+    {
+        TRACE_SCOPE("VectorStorage::search.scoreStream");
+        auto stream = pqxx::stream_from::query(w, scoreSql.str());
+        for (auto [id, title, tokenStats, knnScore] : stream.iter<
+            int64_t, std::string_view, std::string_view, float>()) {
+            scored.push_back({ id, rerankScore(features, config, knnScore, title, tokenStats) });
+        }
+        stream.complete();
+    }
 
-        float titleBoost = titleScore(
-            cleanTitle,
-            queryTokens,
-            cleanQuery
-        );
+    std::sort(scored.begin(), scored.end(), [](const ScoredId& a, const ScoredId& b) {
+        return a.score > b.score;
+    });
+    return scored;
+}
 
-        float finalScore =
-            knnScore * 0.55f +
-            keyword * 0.30f +
-            titleBoost * 0.15f;
+std::vector<SearchResult> VectorStorage::fetchRows(pqxx::work& w, const std::vector<ScoredId>& scored)
+{
+    if (scored.empty()) return {};
+    TRACE_SCOPE("VectorStorage::search.fetchRows");
 
+    std::vector<int64_t> ids;
+    ids.reserve(scored.size());
+    for (const auto& s : scored) ids.push_back(s.id);
+
+    pqxx::params p;
+    p.append(ids);
+    pqxx::result r = w.exec("SELECT id, title, description, link FROM vectors WHERE id = ANY($1)", p);
+
+    std::unordered_map<int64_t, pqxx::row> rowOf;
+    for (auto const& row : r) rowOf.emplace(row["id"].as<int64_t>(), row);
+
+    std::vector<SearchResult> results;
+    results.reserve(scored.size());
+    for (const auto& s : scored) {
+        auto it = rowOf.find(s.id);
+        if (it == rowOf.end()) continue;
+        const pqxx::row& row = it->second;
         results.push_back({
-            row["id"].as<int64_t>(),
-            finalScore,
-            title,
+            s.id,
+            s.score,
+            row["title"].as<std::string>(),
             row["description"].as<std::string>(),
             row["link"].as<std::string>()
         });
     }
+    return results;
+}
 
-	// Sort results by final score and return top K
-    std::sort(results.begin(), results.end(),
-        [](const SearchResult& a, const SearchResult& b) {
-            return a.score > b.score;
-        });
-
-	// Resize to topK if we got more results from DB due to expandedK
-    if (results.size() > topK)
-        results.resize(topK);
+// Paginated search with the current search config
+SearchPage VectorStorage::searchPage(
+    const std::string& query,
+    size_t pageSize)
+{
+    return searchPage(query, pageSize, searchConfig);
+}
 
-    return results;
+// First page, the query is embedded once and SESSION_PREFETCH_PAGES pages of candidates are reranked up front
+SearchPage VectorStorage::searchPage(
+    const std::string& query,
+    size_t pageSize,
+    const SearchConfig& config,
+    const SearchFilter& filter)
+{
+    TRACE_SCOPE("VectorStorage::searchPage");
+    pageSize = std::max<size_t>(pageSize, 1);
+
+    auto session = std::make_shared<SearchSession>();
+    session->query = query;
+    session->config = config;
+    session->filter = filter;
+    session->entityQuery = extractEntity(query);
+    size_t count = std::max(pageSize * SESSION_PREFETCH_PAGES, static_cast<size_t>(pageSize * config.expandFactor));
+
+    std::array<std::byte, SEARCH_ARENA_BYTES> arenaBuffer;
+    std::pmr::monotonic_buffer_resource arena(arenaBuffer.data(), arenaBuffer.size());
+    QueryFeatures features(&arena);
+    buildQueryFeatures(query, features);
+
+	// Same overlap as search, the scan is set up for the whole prefetch
+    auto prepared = prepareQuery(features.cleanQuery, session->entityQuery, config, filter,
+        std::max<size_t>(config.efSearch, count));
+
+    session->queryEmbedding = EmbedText(session->entityQuery);
+    if (session->queryEmbedding.empty()) return {};
+
+    session->queryVec = VectorToPGVector(session->queryEmbedding);
+    auto proj = config.useReduced ? currentProjection() : nullptr;
+    session->annColumn = proj ? "embedding_reduced" : "embedding";
+    session->annVec = proj ? VectorToPGVector(proj->project(session->queryEmbedding)) : session->queryVec;
+
+    PreparedQuery ready = prepared.get();
+    pqxx::work& w = *ready.w;
+    extendSession(*session, count, w, ready.plan, ready.titleIds);
+
+    std::string cursor = sessions->add(session);
+    std::lock_guard lock(session->mutex);
+    SearchPage page = takePage(*session, pageSize, cursor, w);
+    w.commit();
+    if (page.cursor.empty()) sessions->remove(cursor);
+    else sessions->update(cursor, session->bytes());
+    return page;
 }
 
-std::string VectorStorage::cleanString(const std::string& text) 
+// Following pages, served from the session until its reranked list runs out
+SearchPage VectorStorage::nextPage(
+    const std::string& cursor,
+    size_t pageSize)
 {
-    std::string out;
-    out.reserve(text.size());
+    TRACE_SCOPE("VectorStorage::nextPage");
+    pageSize = std::max<size_t>(pageSize, 1);
+
+    auto session = sessions->find(cursor);
+    if (!session) {
+        SearchPage expired;
+        expired.expired = true;
+        return expired;
+    }
 
-    for (unsigned char c : text) {
-        if (!std::ispunct(c)) {
-            out.push_back(static_cast<char>(std::tolower(c)));
-        }
+    std::lock_guard lock(session->mutex);
+    auto conn = pool.acquire();
+    pqxx::work w(*conn);
+    if (session->pending.size() < pageSize && !session->exhausted) {
+        size_t count = pageSize * SESSION_PREFETCH_PAGES;
+        FilterPlan plan = setupScan(w, session->config, session->filter, std::max<size_t>(session->config.efSearch, count));
+        extendSession(*session, count, w, plan, {});
     }
 
-    return out;
+    SearchPage page = takePage(*session, pageSize, cursor, w);
+    w.commit();
+    if (page.cursor.empty()) sessions->remove(cursor);
+    else sessions->update(cursor, session->bytes());
+    return page;
 }
 
-// Normalize text for tokenization, also count frequency
-std::unordered_set<std::string> VectorStorage::tokenizeText(const std::string& text) 
+// The first fetch is an ANN query plus title matches, later ones continue the scan past the seen ids
+void VectorStorage::extendSession(
+    SearchSession& session,
+    size_t count,
+    pqxx::work& w,
+    const FilterPlan& plan,
+    const std::vector<int64_t>& extraIds)
 {
-    std::stringstream ss(text);
-    std::unordered_set<std::string> tokens;
-    std::string word;
+    TRACE_SCOPE("VectorStorage::extendSession");
+    const SearchConfig& config = session.config;
 
-    while (ss >> word) {
-        if (word.size() > 3 && word.ends_with("s")) {
-            word.pop_back();
-        }
-        if (!stopwords.contains(word)) {
-            tokens.insert(word);
+    std::array<std::byte, SEARCH_ARENA_BYTES> arenaBuffer;
+    std::pmr::monotonic_buffer_resource arena(arenaBuffer.data(), arenaBuffer.size());
+    QueryFeatures features(&arena);
+    buildQueryFeatures(session.query, features);
+
+	// Flat mode rescans exactly with a deeper k, the seen ids are skipped
+    std::vector<int64_t> ids;
+    bool flatMode = false;
+    if (auto flat = config.useFlatIndex && session.filter.empty() ? currentFlatIndex() : nullptr) {
+        flatMode = true;
+        std::unordered_set<int64_t> seen(session.seenIds.begin(), session.seenIds.end());
+        for (const auto& hit : flat->search(session.queryEmbedding, session.seenIds.size() + count)) {
+            if (!seen.count(hit.id)) ids.push_back(hit.id);
         }
     }
 
-    return tokens;
-}
+    if (!flatMode) {
+        ids = annCandidates(w, session.annColumn, session.annVec, count, session.filter, plan, session.seenIds);
+    }
 
-// Tokenize text and count frequency of each token, used for token_stats column
-std::unordered_map<std::string, int> VectorStorage::tokenizeWithFrequency(const std::string& text) 
-{
-    std::stringstream ss(cleanString(text));
-    std::unordered_map<std::string, int> freq;
-    std::string word;
+    bool endOfIndex = ids.size() < count;
 
-    while (ss >> word) {
-        if (word.size() > 3 && word.ends_with("s")) {
-            word.pop_back();
-        }
-        if (!stopwords.contains(word)) {
-            freq[word]++;
-        }
+    for (int64_t id : extraIds) {
+        if (std::find(ids.begin(), ids.end(), id) == ids.end()) ids.push_back(id);
     }
 
-    return freq;
+    if (ids.empty()) {
+        session.exhausted = true;
+        return;
+    }
+
+    auto scored = scoreCandidates(w, features, session.queryVec, ids, config);
+
+    session.seenIds.insert(session.seenIds.end(), ids.begin(), ids.end());
+    session.pending.insert(session.pending.end(), scored.begin(), scored.end());
+    session.exhausted = endOfIndex;
 }
 
-// Extracts main entity from query by removing common question words and stopwords, also normalizes text
-std::string VectorStorage::extractEntity(const std::string& query)
+SearchPage VectorStorage::takePage(SearchSession& session, size_t pageSize, const std::string& cursor, pqxx::work& w)
 {
-    static const std::vector<std::string> prefixes = {
-        "what is", "what are", "define", "definition of", "explain"
-    };
+    size_t n = std::min(pageSize, session.pending.size());
 
-    std::string q = cleanString(query);
+    SearchPage page;
+    page.results = fetchRows(w, std::vector<ScoredId>(session.pending.begin(), session.pending.begin() + n));
+    session.pending.erase(session.pending.begin(), session.pending.begin() + n);
+    session.served += n;
 
-    for (const auto& p : prefixes) {
-        if (q.rfind(p, 0) == 0) {
-            q.erase(0, p.size());
-            break;
-        }
-    }
-
-    std::stringstream ss(q);
-    std::string word;
-    std::vector<std::string> words;
+    if (!session.pending.empty() || !session.exhausted) page.cursor = cursor;
+    return page;
+}
 
-    while (ss >> word) {
-        if (word == "a" || word == "an" || word == "the") continue;
-        if (word.size() > 3 && word.ends_with("s")) word.pop_back();
-        words.push_back(word);
+// Ids of the expandedK nearest rows by the pgvector index on annColumn
+std::vector<int64_t> VectorStorage::annCandidates(
+    pqxx::work& w,
+    const std::string& annColumn,
+    const std::string& annVec,
+    size_t expandedK,
+    const SearchFilter& filter,
+    const FilterPlan& plan,
+    const std::vector<int64_t>& excludeIds)
+{
+    TRACE_SCOPE("VectorStorage::search.annQuery");
+
+    pqxx::params p;
+    p.append(annVec);
+    p.append(expandedK);
+
+    int nextParam = 3;
+    std::string condition = filterCondition(filter, p, nextParam);
+    if (!excludeIds.empty()) {
+        if (!condition.empty()) condition += " AND ";
+        condition += "id <> ALL($" + std::to_string(nextParam++) + "::BIGINT[])";
+        p.append(excludeIds);
     }
 
-    std::ostringstream out;
-    for (size_t i = 0; i < words.size(); ++i) {
-        if (i) out << " ";
-        out << words[i];
+	// A plain HNSW scan stops after ef_search rows however many the WHERE drops,
+	// iterative scans (pgvector 0.8) keep going, relaxed order is fine since rows are reranked
+	// Filtered scans were already set up by planFilteredScan
+    if (filter.empty() && (!excludeIds.empty() || expandedK > HNSW_MAX_EF_SEARCH)) {
+        w.exec("SET LOCAL hnsw.iterative_scan = relaxed_order");
     }
 
-    return out.str();
-}
+    std::ostringstream sql;
+    sql <<
+        "SELECT id "
+        "FROM vectors ";
+    if (!condition.empty()) sql << "WHERE " << condition << " ";
+    sql <<
+        "ORDER BY " << annColumn << " <=> $1::vector "
+        "LIMIT $2";
 
-// Converts a vector to a string, used for SQL queries
-std::string VectorStorage::VectorToPGVector(const std::vector<float>& v) {
-    std::ostringstream vec;
-    vec << "[";
-    for (size_t i = 0; i < v.size(); ++i) {
-        if (i) vec << ",";
-        vec << std::fixed << std::setprecision(6) << v[i];
+    auto fetch = [&] {
+        pqxx::result r = w.exec(sql.str(), p);
+
+        std::vector<int64_t> ids;
+        ids.reserve(r.size());
+        for (auto const& row : r) {
+            ids.push_back(row["id"].as<int64_t>());
+        }
+        return ids;
+    };
+    std::vector<int64_t> ids = fetch();
+
+	// The iterative scan gives up after FILTER_MAX_SCAN_TUPLES, if more rows should match the exact prefilter finds them
+    if (!filter.empty() && !plan.exact && ids.size() < expandedK
+        && plan.estimatedRows > static_cast<double>(ids.size() + excludeIds.size())) {
+        TRACE_SCOPE("VectorStorage::search.filterFallback");
+        w.exec("SET LOCAL enable_indexscan = off");
+        ids = fetch();
     }
-    vec << "]";
-    return vec.str();
+    return ids;
 }
 
-// Parses the token_stats field from the database, converting the array of (hash, freq) tuples back into a map of hash to frequency
-std::unordered_map<int64_t, int> VectorStorage::parseTokenStats(const pqxx::field& field)
+std::string VectorStorage::filterCondition(const SearchFilter& filter, pqxx::params& p, int& nextParam)
 {
-    std::unordered_map<int64_t, int> freqMap;
+    std::string condition;
+    auto add = [&](const std::string& term) {
+        if (!condition.empty()) condition += " AND ";
+        condition += term;
+    };
 
-    if (field.is_null()) return freqMap;
+	// Integers are inlined, strings always go through parameters
+    if (filter.ns) add("ns = " + std::to_string(*filter.ns));
+    if (filter.minLength > 0) add("article_length >= " + std::to_string(filter.minLength));
+    if (!filter.category.empty()) {
+        add("categories @> ARRAY[$" + std::to_string(nextParam++) + "::TEXT]");
+        p.append(filter.category);
+    }
+    if (!filter.updatedAfter.empty()) {
+        add("updated_at >= $" + std::to_string(nextParam++) + "::TIMESTAMPTZ");
+        p.append(filter.updatedAfter);
+    }
+    if (!filter.updatedBefore.empty()) {
+        add("updated_at < $" + std::to_string(nextParam++) + "::TIMESTAMPTZ");
+        p.append(filter.updatedBefore);
+    }
+    return condition;
+}
 
-    std::string_view s = field.view();
-    size_t i = 0;
+double VectorStorage::estimateFilterRows(pqxx::work& w, const SearchFilter& filter)
+{
+    TRACE_SCOPE("VectorStorage::search.filterEstimate");
 
-    while ((i = s.find('(', i)) != std::string_view::npos) {
-        ++i;
+    pqxx::params p;
+    int nextParam = 1;
+    std::string condition = filterCondition(filter, p, nextParam);
+    if (condition.empty()) return 0.0;
 
-        // parse hash
-        size_t comma = s.find(',', i);
-        int64_t hash = std::stoll(std::string(s.substr(i, comma - i)));
+    pqxx::result r = w.exec("EXPLAIN (FORMAT JSON) SELECT id FROM vectors WHERE " + condition, p);
+    if (r.empty()) return 0.0;
 
-        // parse freq
-        size_t close = s.find(')', comma);
-        int freq = std::stoi(std::string(s.substr(comma + 1, close - comma - 1)));
+    auto plan = nlohmann::json::parse(r[0][0].c_str(), nullptr, false);
+    if (plan.is_discarded() || !plan.is_array() || plan.empty()) return 0.0;
+    return plan[0]["Plan"].value("Plan Rows", 0.0);
+}
 
-        freqMap[hash] = freq;
-        i = close + 1;
+// Selective filters match few enough rows that sorting them all by distance beats walking the graph,
+// with index scans off HNSW is skipped while the filter's btree and GIN indexes still run as bitmap scans.
+// Broad filters walk HNSW iteratively until enough rows pass, capped so a bad estimate can't read the whole graph.
+VectorStorage::FilterPlan VectorStorage::planFilteredScan(pqxx::work& w, const SearchFilter& filter)
+{
+    FilterPlan plan;
+    plan.estimatedRows = estimateFilterRows(w, filter);
+    if (plan.estimatedRows <= static_cast<double>(FILTER_EXACT_ROWS)) {
+        w.exec("SET LOCAL enable_indexscan = off");
+        plan.exact = true;
+        return plan;
     }
 
-    return freqMap;
+    w.exec("SET LOCAL hnsw.iterative_scan = relaxed_order");
+    w.exec("SET LOCAL hnsw.max_scan_tuples = " + std::to_string(FILTER_MAX_SCAN_TUPLES));
+    return plan;
 }
 
-// Computes a keyword score based on the overlap of hashed query tokens and document token frequencies, using logarithmic scaling for frequency and normalizing by the number of query tokens
-float VectorStorage::keywordScore(
-    const std::unordered_set<int64_t>& queryHashes,
-    const std::unordered_map<int64_t, int>& docFreqs
-) {
-    if (queryHashes.empty() || docFreqs.empty()) return 0.0f;
+// Title candidates come from memory and bypass the ANN query's filter, so they are checked separately
+std::vector<int64_t> VectorStorage::filterIds(
+    pqxx::work& w,
+    const std::vector<int64_t>& ids,
+    const SearchFilter& filter)
+{
+    if (ids.empty() || filter.empty()) return ids;
 
-    float score = 0.0f;
+    pqxx::params p;
+    p.append(ids);
+    int nextParam = 2;
+    std::string condition = filterCondition(filter, p, nextParam);
 
-    for (int64_t q : queryHashes) {
-        auto it = docFreqs.find(q);
-        if (it != docFreqs.end()) {
-            score += std::log1p(static_cast<float>(it->second));
-        }
-    }
+    pqxx::result r = w.exec("SELECT id FROM vectors WHERE id = ANY($1) AND " + condition, p);
+    std::unordered_set<int64_t> passed;
+    for (auto const& row : r) passed.insert(row["id"].as<int64_t>());
 
-    return score / static_cast<float>(queryHashes.size());
+    std::vector<int64_t> kept;
+    for (int64_t id : ids) {
+        if (passed.count(id)) kept.push_back(id);
+    }
+    return kept;
 }
 
-// Computes a title score based on exact match, partial match, and token overlap between the query and the document title
-float VectorStorage::titleScore(
-    const std::string& cleanTitle,
-    const std::unordered_set<std::string>& queryTokens,
-    const std::string& cleanQuery
-) {
-    float score = 0.0f;
+std::vector<int64_t> VectorStorage::titleCandidates(
+    std::string_view cleanQuery,
+    std::string_view entityQuery) const
+{
+    if (cleanQuery.empty() && entityQuery.empty()) return {};
+
+	// A very short prefix matches a large part of the corpus, its shortest titles would be noise
+    std::vector<int64_t> ids = titleIndex.exact(cleanQuery);
+    std::vector<int64_t> prefixed;
+    if (cleanQuery.size() >= TITLE_PREFIX_MIN_CHARS) prefixed = titleIndex.prefixIds(cleanQuery, TITLE_PREFIX_CANDIDATES);
+    std::vector<int64_t> entity;
+    if (!entityQuery.empty()) entity = titleIndex.exact(entityQuery);
+
+    for (const auto& more : { entity, prefixed }) {
+        for (int64_t id : more) {
+            if (std::find(ids.begin(), ids.end(), id) == ids.end()) ids.push_back(id);
+        }
+    }
+    return ids;
+}
 
-    if (cleanTitle == cleanQuery)
-        return 2.5f;               // exact match wins immediately
+// Candidates are gathered and scored by hybrid_rank, only topK rows cross the wire
+std::vector<SearchResult> VectorStorage::searchInDatabase(
+    pqxx::work& w,
+    const QueryFeatures& features,
+    const std::vector<int64_t>& extraIds,
+    const std::string& queryVec,
+    const std::string& annColumn,
+    const std::string& annVec,
+    size_t expandedK,
+    size_t topK,
+    const SearchConfig& config,
+    const SearchFilter& filter)
+{
+    TRACE_SCOPE("VectorStorage::searchInDatabase");
+
+    std::vector<int64_t> hashes(features.hashes.begin(), features.hashes.end());
+    std::vector<std::string> tokens(features.tokens.begin(), features.tokens.end());
+
+    pqxx::params p;
+    p.append(queryVec);
+    p.append(annVec);
+    p.append(expandedK);
+    p.append(extraIds);
+    p.append(hashes);
+    p.append(tokens);
+    p.append(std::string(features.cleanQuery));
+    p.append(config.knnWeight);
+    p.append(config.keywordWeight);
+    p.append(config.titleWeight);
+    p.append(static_cast<int>(topK));
+
+	// The filter applies to the ANN subquery and to the extra ids, which come from outside the index
+    int nextParam = 12;
+    std::string condition = filterCondition(filter, p, nextParam);
 
-    if (cleanTitle.find(cleanQuery) != std::string::npos)
-        score += 1.5f;             // strong partial match
+    std::ostringstream sql;
+    sql <<
+        "SELECT id, score, title, description, link "
+        "FROM hybrid_rank("
+        "$1::vector, ";
+    if (condition.empty()) {
+        sql << "ARRAY(SELECT id::BIGINT FROM vectors ORDER BY " << annColumn << " <=> $2::vector LIMIT $3) || $4::BIGINT[], ";
+    }
+    else {
+        sql <<
+            "ARRAY(SELECT id::BIGINT FROM vectors WHERE " << condition
+            << " ORDER BY " << annColumn << " <=> $2::vector LIMIT $3) || "
+            "ARRAY(SELECT id::BIGINT FROM vectors WHERE id = ANY($4::BIGINT[]) AND " << condition << "), ";
+    }
+    sql << "$5::BIGINT[], $6::TEXT[], $7, $8, $9, $10, $11)";
 
-    if (!queryTokens.empty()) {
-        int overlap = 0;
-        for (const auto& t : queryTokens)
-            overlap += (cleanTitle.find(t) != std::string::npos);
+    pqxx::result r = w.exec(sql.str(), p);
 
-        score += static_cast<float>(overlap) /
-            static_cast<float>(queryTokens.size());
+    std::vector<SearchResult> results;
+    results.reserve(r.size());
+    for (auto const& row : r) {
+        results.push_back({
+            row["id"].as<int64_t>(),
+            row["score"].as<float>(),
+            row["title"].as<std::string>(),
+            row["description"].as<std::string>(),
+            row["link"].as<std::string>()
+        });
     }
-
-    return score;
+    return results;
 }
 
-// Used to build the token_stats array for SQL insertion, converts token frequencies to an array of (hash, freq) tuples
-std::string VectorStorage::buildTokenStatArray(
-    const std::unordered_map<std::string, int>& tokenFreq
-) {
-    std::ostringstream out;
-    std::hash<std::string> hasher;
+// Converts a vector to a string, used for SQL queries
+std::string VectorStorage::VectorToPGVector(const std::vector<float>& v) {
+    return VectorToPGVector(v.data(), v.size());
+}
 
-    out << "ARRAY[";
+std::string VectorStorage::VectorToPGVector(const float* v, size_t n) {
+    std::string vec;
+    vec.reserve(2 + n * 10);
+    vec.push_back('[');
 
-    bool first = true;
-    for (const auto& [token, count] : tokenFreq) {
-        if (!first) out << ",";
-        first = false;
+    char buf[32];
+    for (size_t i = 0; i < n; ++i) {
+        if (i) vec.push_back(',');
+        auto res = std::to_chars(buf, buf + sizeof(buf), v[i], std::chars_format::fixed, 6);
+        vec.append(buf, res.ptr);
+    }
+    vec.push_back(']');
+    return vec;
+}
 
-        int64_t hash = static_cast<int64_t>(hasher(token));
-        int freq = std::min(count, 32767); // SMALLINT safety
+std::string VectorStorage::IdsToPGArray(const std::vector<int64_t>& ids) {
+    std::string arr;
+    arr.reserve(2 + ids.size() * 12);
+    arr.push_back('{');
 
-        out << "ROW(" << hash << "," << freq << ")::token_stat";
+    char buf[24];
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i) arr.push_back(',');
+        arr.append(buf, std::to_chars(buf, buf + sizeof(buf), ids[i]).ptr);
     }
+    arr.push_back('}');
+    return arr;
+}
 
-    out << "]";
-
-    if (tokenFreq.empty()) {
-        return "ARRAY[]::token_stat[]";
-	}
+// Used to build the token_stats value for COPY, an array of (hash, freq) composites in text form: {"(h,f)","(h,f)"}
+std::string VectorStorage::buildTokenStatArray(
+    const std::vector<TokenStat>& stats
+) {
+    std::string out;
+    out.reserve(2 + stats.size() * 28);
+    out.push_back('{');
+
+    char buf[24];
+    for (size_t i = 0; i < stats.size(); ++i) {
+        if (i) out.push_back(',');
+        out.append("\"(");
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), stats[i].hash).ptr);
+        out.push_back(',');
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), stats[i].freq).ptr);
+        out.append(")\"");
+    }
 
-    return out.str();
+    out.push_back('}');
+    return out;
 }
 
-// Creates hash of a set
-std::vector<int64_t> VectorStorage::hashTokens(const std::unordered_set<std::string>& tokens) {
-    std::vector<int64_t> hashes;
-    hashes.reserve(tokens.size());
+std::string VectorStorage::buildTextArray(
+    std::string_view lines
+) {
+    std::string out;
+    out.reserve(2 + lines.size() * 2);
+    out.push_back('{');
+
+	// Elements are always quoted, so only quotes and backslashes need escaping
+    bool first = true;
+    while (!lines.empty()) {
+        size_t end = lines.find('\n');
+        std::string_view item = lines.substr(0, end);
+        lines = end == std::string_view::npos ? std::string_view{} : lines.substr(end + 1);
+        if (item.empty()) continue;
 
-    std::hash<std::string> hasher;
-    for (const auto& token : tokens) {
-        uint64_t h = hasher(token);                 // 64-bit unsigned hash
-        hashes.push_back(static_cast<int64_t>(h));  // cast to signed 64-bit
+        if (!first) out.push_back(',');
+        first = false;
+        out.push_back('"');
+        for (char c : item) {
+            if (c == '"' || c == '\\') out.push_back('\\');
+            out.push_back(c);
+        }
+        out.push_back('"');
     }
 
-    return hashes;
-}
\ No newline at end of file
+    out.push_back('}');
+    return out;
+}
@@ -1,13 +1,26 @@
 #pragma once
+#include "ConnectionPool.h"
+#include "EmbeddingDispatcher.h"
+#include "EmbeddingMatrix.h"
+#include "EmbeddingProjection.h"
+#include "FlatIndex.h"
 #include "ONNXEmbedder.h"
 #include "PageItem.h"
+#include "PriorityScheduler.h"
+#include "TitleIndex.h"
 
 #include <vector>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <mutex>
-#include <httplib.h>
+#include <shared_mutex>
 #include <unordered_set>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <cstdint>
 #include <pqxx/pqxx>
 #include <pqxx/connection.hxx>
@@ -16,8 +29,26 @@
 This class manages vector storage, including embedding texts, searching, and indexing using HNSW.
 */
 
+struct QueryFeatures;
+struct SearchSession;
+class SearchSessionStore;
+
 constexpr size_t DIM = 384;                 // Dimension of embeddings
+constexpr int SCHEMA_VERSION = 2;           // Bump when createSchema changes, stamped on the vectors table by --migrate
 constexpr size_t MAX_ELEMENTS = 2'000'000;  // Maximum number of elements in HNSW index
+constexpr size_t TITLE_PREFIX_CANDIDATES = 3; // Title prefix matches injected into search candidates
+constexpr size_t TITLE_PREFIX_MIN_CHARS = 3; // Shorter cleaned queries inject no prefix matches
+constexpr size_t SEARCH_ARENA_BYTES = 8192; // Stack arena per search for query features and scored rows
+constexpr size_t INGEST_EMBED_CHUNK = 16;   // Texts embedded per scheduler ticket during ingest
+constexpr size_t PROJECTION_BATCH = 1000;   // Rows re-projected per UPDATE when backfilling reduced vectors
+constexpr size_t FLAT_EXPORT_BATCH = 10'000; // Rows read per query when exporting the flat index
+constexpr size_t SESSION_PREFETCH_PAGES = 5; // Pages of candidates reranked per fetch for a paginated search
+constexpr auto SESSION_TTL = std::chrono::minutes(5);           // Idle time before a search cursor expires
+constexpr size_t SESSION_MEMORY_BYTES = 64ull * 1024 * 1024;    // Memory budget of all open search sessions
+constexpr size_t SESSION_MAX_COUNT = 1000;  // Open search sessions, least recently used are evicted first
+constexpr size_t FILTER_EXACT_ROWS = 20'000; // Filters estimated to match fewer rows are scanned exactly instead of through HNSW
+constexpr size_t FILTER_MAX_SCAN_TUPLES = 100'000; // hnsw.max_scan_tuples for filtered iterative scans, exact scan takes over past it
+constexpr size_t HNSW_MAX_EF_SEARCH = 1000; // pgvector rejects a larger hnsw.ef_search, deeper scans are iterative
 
 // Holds search result
 struct SearchResult {
@@ -28,95 +59,352 @@ struct SearchResult {
     std::string link;
 };
 
-// Holds token hash and frequency for a document, used for token overlap scoring
-struct TokenStat {
-    int64_t hash;
-    int16_t freq;
+// Candidate id with its rerank score, the row's text is fetched only once it is shown
+struct ScoredId {
+    int64_t id;
+    float score = 0.0f;
+};
+
+// One page of results, cursor fetches the next page and is empty once there are no more
+struct SearchPage {
+    std::vector<SearchResult> results;
+    std::string cursor;
+    bool expired = false;           // the cursor's session timed out or was evicted, the query has to be run again
+};
+
+// Metadata filter for search, unset fields don't filter
+struct SearchFilter {
+    std::optional<int> ns;          // namespace, 0 for articles
+    std::string category;           // lowercase category name, matched exactly
+    std::string updatedAfter;       // ISO 8601 date or timestamp, inclusive
+    std::string updatedBefore;      // ISO 8601 date or timestamp, exclusive
+    int minLength = 0;              // minimum wikitext length in characters
+
+    bool empty() const
+    {
+        return !ns && category.empty() && updatedAfter.empty() && updatedBefore.empty() && minLength <= 0;
+    }
+};
+
+// Tunable search parameters, changes should be signed off with SearchBenchmark
+struct SearchConfig {
+    int efSearch = 64;              // hnsw.ef_search used for the ANN query
+    float expandFactor = 1.5f;      // ANN candidates fetched per requested result
+    float knnWeight = 0.55f;        // weight of embedding similarity
+    float keywordWeight = 0.30f;    // weight of token overlap
+    float titleWeight = 0.15f;      // weight of title heuristics
+    bool exact = false;             // brute-force exact cosine scan instead of HNSW, used as ground truth
+    bool useReduced = false;        // ANN over the reduced embedding column, rerank still uses full vectors
+    bool serverRerank = false;      // score candidates in Postgres with hybrid_rank, only topK rows come back
+    bool useFlatIndex = false;      // candidates from an exact SIMD scan of the exported FlatIndex instead of pgvector
+};
+
+// Summary of a learned projection, recall compares exact top-k in reduced vs full dimensions
+struct ProjectionReport {
+    size_t outDim = 0;
+    size_t samples = 0;
+    size_t rowsProjected = 0;
+    double explainedVariance = 0.0;
+    double recallAtK = 0.0;
+    size_t k = 10;
+};
+
+// Candidates scored client side by search and the heap allocations made while scoring them, since startup
+struct RankStats {
+    uint64_t candidates = 0;
+    uint64_t allocations = 0;
 };
 
 class VectorStorage {
 public:
-    VectorStorage(
-        pqxx::connection& conn,
-        size_t threadCount
+    // migrate runs the schema DDL, otherwise the schema must already be current (see schemaIsCurrent)
+    explicit VectorStorage(
+        ConnectionPool& pool,
+        bool migrate = false
     );
+    ~VectorStorage();
 
-    void ingestBatch(const std::vector<PageItem>& pages);
+    // One catalog lookup, true when the schema was created by this version's migrate step
+    static bool schemaIsCurrent(ConnectionPool& pool);
+
+    // Embed and insert a batch, taken by value so its arenas are released as soon as it is stored
+    void ingestBatch(ArticleBatch batch);
 
     std::vector<SearchResult> search(
         const std::string& query,
         size_t topK
     );
 
+    // Search with explicit parameters, safe to call from multiple threads
+    std::vector<SearchResult> search(
+        const std::string& query,
+        size_t topK,
+        const SearchConfig& config,
+        const SearchFilter& filter = SearchFilter{}
+    );
+
+    // First page of a search, opens a session behind the returned cursor so following pages are served from memory
+    SearchPage searchPage(
+        const std::string& query,
+        size_t pageSize
+    );
+
+    SearchPage searchPage(
+        const std::string& query,
+        size_t pageSize,
+        const SearchConfig& config,
+        const SearchFilter& filter = SearchFilter{}
+    );
+
+    // Next page of a cursor, the index scan is continued past the seen candidates only when the session runs out
+    SearchPage nextPage(
+        const std::string& cursor,
+        size_t pageSize
+    );
+
+    const SearchConfig& getSearchConfig() const;
+    void setSearchConfig(const SearchConfig& config);
+
+    // Learn a PCA projection from sampled embeddings, backfill and index the reduced column
+    ProjectionReport buildProjection(
+        size_t outDim,
+        size_t sampleSize,
+        size_t evalQueries
+    );
+
+    bool hasProjection() const;
+
+    // Snapshot the embedding column into a memory-mapped flat index file and load it, returns rows exported
+    size_t exportFlatIndex(
+        const std::string& path,
+        FlatElement element
+    );
+
+    // Load the newest exported version of path, false when there is none
+    bool loadFlatIndex(const std::string& path);
+    bool hasFlatIndex() const;
+
+    RankStats rankStats() const;
+
+    // Cap the share of wall time ingest may spend on the local embedder, queries are never throttled
+    void setIngestCpuShare(double share);
+
+    // Send ingest embedding to out-of-process workers ("host:port"), queries stay on the local embedder
+    void setEmbeddingWorkers(
+        const std::vector<std::string>& endpoints
+    );
+
+    // Prefix autocomplete over article titles, served from memory
+    std::vector<TitleMatch> suggestTitles(
+        const std::string& prefix,
+        size_t limit
+    );
+
 private:
-    pqxx::connection& conn;
-    size_t threadCount;
+    ConnectionPool& pool;
+    SearchConfig searchConfig;
 
-    std::unique_ptr<ONNXEmbedder> embedder;
+    std::unique_ptr<ONNXEmbedder> embedder; // ONNX Runtime sessions are safe to run concurrently
+    PriorityScheduler embedScheduler;       // gives query embedding priority over ingest on the embedder
+    TitleIndex titleIndex;                  // In-memory title index for autocomplete and exact title candidates
 
-    std::vector<int64_t> insertBatch(
-        const std::vector<PageItem>& pages,
-        const std::vector<std::vector<float>>& embeddings
+    std::shared_ptr<const EmbeddingProjection> projection;  // null until a projection is built or loaded
+    mutable std::mutex projectionMutex;
+    std::shared_mutex projectionSwap;       // shared by inserts from projection lookup to commit, exclusive while the reduced column is replaced
+
+    std::shared_ptr<const FlatIndex> flatIndex;     // null until exported or loaded
+    mutable std::mutex flatIndexMutex;
+
+    std::atomic<uint64_t> rankedCandidates{ 0 };
+    std::atomic<uint64_t> rankAllocations{ 0 };
+
+    void createSchema();
+    void loadTitleIndex();
+    void loadProjection();
+    std::shared_ptr<const EmbeddingProjection> currentProjection() const;
+    std::shared_ptr<const FlatIndex> currentFlatIndex() const;
+
+    double projectionRecall(
+        const EmbeddingProjection& proj,
+        size_t evalQueries,
+        size_t k
     );
 
-    std::vector<std::vector<float>> embedBatch(
-        const std::vector<std::string>& texts
+    // How a filtered ANN query was set up, see planFilteredScan
+    struct FilterPlan {
+        double estimatedRows = 0.0;
+        bool exact = false;         // index scans are off, rows matching the filter are sorted by distance
+    };
+
+    // A checked out connection and transaction set up for the ANN query, with the filtered title candidates
+    struct PreparedQuery {
+        ConnectionPool::Lease conn;
+        std::unique_ptr<pqxx::work> w;      // declared after conn, so it ends before the lease is returned
+        FilterPlan plan;
+        std::vector<int64_t> titleIds;
+    };
+
+    // Start checkout, scan setup and title lookups on another thread, so they overlap embedding the query
+    // The views must stay valid until the future is joined
+    std::future<PreparedQuery> prepareQuery(
+        std::string_view cleanQuery,
+        std::string_view entityQuery,
+        const SearchConfig& config,
+        const SearchFilter& filter,
+        size_t efSearch
     );
 
-    std::vector<float> EmbedText(
-        const std::string& text
+    // Set up the transaction for an exact, plain HNSW or filtered scan of up to efSearch rows
+    FilterPlan setupScan(
+        pqxx::work& w,
+        const SearchConfig& config,
+        const SearchFilter& filter,
+        size_t efSearch
     );
 
-    std::string VectorToPGVector(
-        const std::vector<float>& v
+    // Nearest ids passing filter and not in excludeIds, the transaction must already be set up by setupScan
+    std::vector<int64_t> annCandidates(
+        pqxx::work& w,
+        const std::string& annColumn,
+        const std::string& annVec,
+        size_t expandedK,
+        const SearchFilter& filter,
+        const FilterPlan& plan,
+        const std::vector<int64_t>& excludeIds
     );
 
-    std::unordered_map<std::string, int> tokenizeWithFrequency(
-        const std::string& text
+    // The ids that pass filter, in their original order
+    std::vector<int64_t> filterIds(
+        pqxx::work& w,
+        const std::vector<int64_t>& ids,
+        const SearchFilter& filter
     );
 
-    std::string buildTokenStatArray(
-        const std::unordered_map<std::string, int>& tokenFreq
+    // SQL condition for filter, string values are appended to p as $nextParam onwards, empty when unfiltered
+    static std::string filterCondition(
+        const SearchFilter& filter,
+        pqxx::params& p,
+        int& nextParam
     );
 
-    std::unordered_set<std::string> tokenizeText(
-        const std::string& text
+    // Planner estimate of the rows matching filter, from EXPLAIN so nothing is scanned
+    double estimateFilterRows(
+        pqxx::work& w,
+        const SearchFilter& filter
+    );
+
+    // Pick the scan for a filtered ANN query by estimated selectivity and set up the transaction for it
+    FilterPlan planFilteredScan(
+        pqxx::work& w,
+        const SearchFilter& filter
+    );
+
+    // Exact and prefix title matches injected into the candidates, ANN may not have returned them
+    std::vector<int64_t> titleCandidates(
+        std::string_view cleanQuery,
+        std::string_view entityQuery
+    ) const;
+
+    // Score candidate ids and return up to limit of them best first, in Postgres when config.serverRerank is set
+    // The ids must already pass the search filter
+    std::vector<SearchResult> rankCandidates(
+        pqxx::work& w,
+        const QueryFeatures& features,
+        const std::string& queryVec,
+        const std::vector<int64_t>& ids,
+        size_t limit,
+        const SearchConfig& config,
+        std::pmr::memory_resource* arena
+    );
+
+    // Score all candidate ids, best first, without reading their text
+    // The ids must already pass the search filter
+    std::vector<ScoredId> scoreCandidates(
+        pqxx::work& w,
+        const QueryFeatures& features,
+        const std::string& queryVec,
+        const std::vector<int64_t>& ids,
+        const SearchConfig& config
     );
 
-    std::vector<int64_t> hashTokens(
-        const std::unordered_set<std::string>& tokens
+    // Title, description and link for the scored ids, in their order, rows deleted meanwhile are skipped
+    std::vector<SearchResult> fetchRows(
+        pqxx::work& w,
+        const std::vector<ScoredId>& scored
     );
 
-    std::string extractEntity(
-        const std::string& query
+    // Fetch and rank up to count candidates past the session's seen ids, marks the session exhausted at the end of the index
+    // The transaction must be set up by setupScan, extraIds are ranked along with them and must pass the filter
+    void extendSession(
+        SearchSession& session,
+        size_t count,
+        pqxx::work& w,
+        const FilterPlan& plan,
+        const std::vector<int64_t>& extraIds
     );
 
-    std::unordered_map<int64_t, int> parseTokenStats(
-        const pqxx::field& field
+    // Move the next page out of the session and fetch its rows
+    SearchPage takePage(
+        SearchSession& session,
+        size_t pageSize,
+        const std::string& cursor,
+        pqxx::work& w
     );
 
-    float keywordScore(
-        const std::unordered_set<int64_t>& queryHashes,
-        const std::unordered_map<int64_t, int>& docFreqs
+    // ANN and hybrid_rank in one statement, returns the final topK
+    std::vector<SearchResult> searchInDatabase(
+        pqxx::work& w,
+        const QueryFeatures& features,
+        const std::vector<int64_t>& extraIds,
+        const std::string& queryVec,
+        const std::string& annColumn,
+        const std::string& annVec,
+        size_t expandedK,
+        size_t topK,
+        const SearchConfig& config,
+        const SearchFilter& filter
     );
 
-    float titleScore(
-        const std::string& cleanTitle,
-        const std::unordered_set<std::string>& queryTokens,
-        const std::string& cleanQuery
+    // COPY the rows in with ids drawn from the sequence up front, returns the ids in page order
+    std::vector<int64_t> insertBatch(
+        const std::vector<PageItem>& pages,
+        const EmbeddingMatrix& embeddings
+    );
+
+    EmbeddingMatrix embedBatch(
+        const std::vector<std::string_view>& texts
     );
 
-    std::string cleanString(
+    std::vector<float> EmbedText(
         const std::string& text
     );
 
-private:
-    const std::unordered_set<std::string> stopwords = {
-        "a", "an", "the", "is", "are", "was", "were",
-        "of", "to", "in", "on", "for", "with",
-        "what", "who", "when", "where", "why", "how",
-        "define", "definition", "explain"
-    };
+    std::string VectorToPGVector(
+        const std::vector<float>& v
+    );
+
+    std::string VectorToPGVector(
+        const float* v,
+        size_t n
+    );
+
+    // BIGINT[] literal for queries that can't take parameters, like COPY
+    static std::string IdsToPGArray(
+        const std::vector<int64_t>& ids
+    );
+
+    // token_stat[] in Postgres array text form, as read by COPY
+    std::string buildTokenStatArray(
+        const std::vector<TokenStat>& stats
+    );
+
+    // TEXT[] in Postgres array text form from newline separated values
+    std::string buildTextArray(
+        std::string_view lines
+    );
+
+    std::unique_ptr<EmbeddingDispatcher> dispatcher;    // embedding workers for ingest, null when embedding locally
+    std::unique_ptr<SearchSessionStore> sessions;       // state behind search cursors
 
-    httplib::Client client;                 // HTTP client for embedding server
+    std::shared_future<void> startupTask;   // title index load and model warm-up, declared last so it is joined first
 };
\ No newline at end of file
@@ -1,40 +1,175 @@
 #include "WordPieceTokenizer.h"
+#include "Trace.h"
+#include <cctype>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
-#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <cstdint>
 
+namespace fs = std::filesystem;
+
+constexpr char VOCAB_MAGIC[8] = { 'E', 'D', 'B', 'V', 'O', 'C', 'B', '\0' };
+constexpr uint32_t VOCAB_VERSION = 1;
+constexpr size_t VOCAB_HEADER_BYTES = 24;   // magic, version, count, slot count, pool offset
+constexpr size_t VOCAB_SLOT_BYTES = 12;     // u32 offset, u32 length, u32 id
+constexpr uint32_t VOCAB_EMPTY = 0xffffffff;
+
+// FNV-1a, stable across compilers unlike std::hash, the table is written to disk
+static uint32_t vocabHash(std::string_view s)
+{
+    uint32_t h = 2166136261u;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t readU32(const char* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
 // Constructor
 WordPieceTokenizer::WordPieceTokenizer(const std::string& vocabPath) {
+    TRACE_SCOPE("WordPieceTokenizer::load");
+    std::string binPath = fs::path(vocabPath).replace_extension(".bin").string();
+
+	// Rebuild the binary vocab when it is missing or older than vocab.txt
+    std::error_code ec;
+    if (!fs::exists(binPath, ec) || fs::last_write_time(binPath, ec) < fs::last_write_time(vocabPath, ec)) {
+        buildBinaryVocab(vocabPath, binPath);
+    }
+
+    vocabFile = MappedFile(binPath, MapAdvice::Random);
+    const char* data = vocabFile.data();
+    if (vocabFile.size() < VOCAB_HEADER_BYTES || std::memcmp(data, VOCAB_MAGIC, sizeof(VOCAB_MAGIC)) != 0
+        || readU32(data + 8) != VOCAB_VERSION) {
+        throw std::runtime_error("Invalid binary vocab " + binPath + ", delete it to rebuild");
+    }
+
+    uint32_t slotCount = readU32(data + 16);
+    uint32_t poolOffset = readU32(data + 20);
+    if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0
+        || poolOffset != VOCAB_HEADER_BYTES + static_cast<size_t>(slotCount) * VOCAB_SLOT_BYTES
+        || poolOffset > vocabFile.size()) {
+        throw std::runtime_error("Invalid binary vocab " + binPath + ", delete it to rebuild");
+    }
+
+    slots = data + VOCAB_HEADER_BYTES;
+    pool = data + poolOffset;
+    slotMask = slotCount - 1;
+
+	// Set special token IDs
+    auto special = [this](std::string_view token) {
+        int64_t id = lookup(token);
+        return id < 0 ? 0 : id;
+    };
+    pad_id = special("[PAD]");
+    cls_id = special("[CLS]");
+    sep_id = special("[SEP]");
+    unk_id = special("[UNK]");
+}
+
+// Linear probing over the mapped table
+int64_t WordPieceTokenizer::lookup(std::string_view token) const {
+    for (uint32_t i = vocabHash(token) & slotMask; ; i = (i + 1) & slotMask) {
+        const char* slot = slots + static_cast<size_t>(i) * VOCAB_SLOT_BYTES;
+        uint32_t id = readU32(slot + 8);
+        if (id == VOCAB_EMPTY) return -1;
+
+        uint32_t offset = readU32(slot);
+        uint32_t length = readU32(slot + 4);
+        if (length == token.size() && std::memcmp(pool + offset, token.data(), length) == 0) return id;
+    }
+}
+
+// Parse vocab.txt, line number is the token id, and write the table at half load
+void WordPieceTokenizer::buildBinaryVocab(const std::string& vocabPath, const std::string& binPath) {
     std::ifstream f(vocabPath);
-    std::string token;
-    int64_t id = 0;
+    if (!f) throw std::runtime_error("Could not open vocab " + vocabPath);
 
-	// Load vocab file and build token to ID mapping
+    std::unordered_map<std::string, uint32_t> vocab;
+    std::string token;
+    uint32_t id = 0;
     while (std::getline(f, token)) {
+        if (!token.empty() && token.back() == '\r') token.pop_back();
         vocab[token] = id++;
     }
 
-	// Set special token IDs
-    pad_id = vocab["[PAD]"];    
-    cls_id = vocab["[CLS]"];
-    sep_id = vocab["[SEP]"];
-    unk_id = vocab["[UNK]"];
+    uint32_t slotCount = 1;
+    while (slotCount < vocab.size() * 2) slotCount <<= 1;
+    uint32_t mask = slotCount - 1;
+
+    std::vector<char> table(static_cast<size_t>(slotCount) * VOCAB_SLOT_BYTES);
+    for (uint32_t i = 0; i < slotCount; ++i) {
+        std::memcpy(table.data() + static_cast<size_t>(i) * VOCAB_SLOT_BYTES + 8, &VOCAB_EMPTY, sizeof(uint32_t));
+    }
+
+    std::string pool;
+    for (const auto& [text, tokenId] : vocab) {
+        uint32_t offset = static_cast<uint32_t>(pool.size());
+        uint32_t length = static_cast<uint32_t>(text.size());
+        pool += text;
+
+        uint32_t i = vocabHash(text) & mask;
+        while (readU32(table.data() + static_cast<size_t>(i) * VOCAB_SLOT_BYTES + 8) != VOCAB_EMPTY) i = (i + 1) & mask;
+
+        char* slot = table.data() + static_cast<size_t>(i) * VOCAB_SLOT_BYTES;
+        std::memcpy(slot, &offset, sizeof(offset));
+        std::memcpy(slot + 4, &length, sizeof(length));
+        std::memcpy(slot + 8, &tokenId, sizeof(tokenId));
+    }
+
+    char header[VOCAB_HEADER_BYTES] = {};
+    uint32_t version = VOCAB_VERSION;
+    uint32_t count = static_cast<uint32_t>(vocab.size());
+    uint32_t poolOffset = static_cast<uint32_t>(VOCAB_HEADER_BYTES + table.size());
+    std::memcpy(header, VOCAB_MAGIC, sizeof(VOCAB_MAGIC));
+    std::memcpy(header + 8, &version, sizeof(version));
+    std::memcpy(header + 12, &count, sizeof(count));
+    std::memcpy(header + 16, &slotCount, sizeof(slotCount));
+    std::memcpy(header + 20, &poolOffset, sizeof(poolOffset));
+
+	// Written to a temporary file first so a concurrent start never maps a partial table
+    std::string tmpPath = binPath + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(header, sizeof(header));
+        out.write(table.data(), table.size());
+        out.write(pool.data(), pool.size());
+        if (!out) throw std::runtime_error("Could not write binary vocab " + tmpPath);
+    }
+    fs::rename(tmpPath, binPath);
+    std::cout << "Compiled " << count << " vocab entries to " << binPath << std::endl;
 }
 
 // Encode text into token IDs with padding/truncation
-std::vector<int64_t> WordPieceTokenizer::encode(const std::string& text, size_t maxLen) const {
+std::vector<int64_t> WordPieceTokenizer::encode(std::string_view text, size_t maxLen) const {
+    TRACE_SCOPE("WordPieceTokenizer::encode");
     std::vector<int64_t> ids;
     ids.reserve(maxLen);
 
     ids.push_back(cls_id);
 
-    std::istringstream iss(text);
-    std::string word;
-    while (iss >> word && ids.size() < maxLen - 1) {
-        auto it = vocab.find(word);
-        ids.push_back(it != vocab.end() ? it->second : unk_id);
+	// Whitespace separated words looked up in place, scanning stops once the sequence is full
+    size_t i = 0;
+    while (i < text.size() && ids.size() < maxLen - 1) {
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) ++i;
+        size_t start = i;
+        while (i < text.size() && !std::isspace(static_cast<unsigned char>(text[i]))) ++i;
+        if (i == start) break;
+
+        int64_t id = lookup(text.substr(start, i - start));
+        ids.push_back(id >= 0 ? id : unk_id);
     }
 
     ids.push_back(sep_id);
@@ -1,25 +1,38 @@
 #pragma once
+#include "MappedFile.h"
+
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 
 /*
 This class implements a WordPiece tokenizer, used on ONNX models
+The vocab is compiled once from vocab.txt into vocab.bin, an open addressing hash table that is memory-mapped at startup
 */
 
+constexpr size_t EMBED_MAX_TOKENS = 128;    // sequence length the embedder pads and truncates every text to
+
 class WordPieceTokenizer {
 private:
-	std::unordered_map<std::string, int64_t> vocab; // token to ID mapping
+	MappedFile vocabFile;           // compiled vocab
+	const char* slots = nullptr;    // hash table of (offset, length, id)
+	const char* pool = nullptr;     // token bytes
+	uint32_t slotMask = 0;          // slot count - 1, slot count is a power of two
+
+	int64_t lookup(std::string_view token) const;  // -1 if not in vocab
+
+	// Compile vocab.txt into the binary table, written next to it
+	static void buildBinaryVocab(const std::string& vocabPath, const std::string& binPath);
 
 public:
     explicit WordPieceTokenizer(const std::string& vocabPath);
 
 	// Encode text into token IDs with padding/truncation
     std::vector<int64_t> encode(
-        const std::string& text,
+        std::string_view text,
         size_t maxLen
     ) const;
 
 	int64_t pad_id, cls_id, sep_id, unk_id;         // special token IDs
-};
\ No newline at end of file
+};
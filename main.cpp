@@ -1,64 +1,283 @@
 #include "ArticleParser.h"
+#include "ConnectionPool.h"
+#include "CorpusFile.h"
+#include "CpuBudget.h"
+#include "EmbeddingWorker.h"
+#include "SearchBenchmark.h"
+#include "Trace.h"
 #include "VectorStorage.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <future>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 #include <exception>
 #include <pqxx/connection.hxx>
 
-int main() {
-	pqxx::connection conn("host=localhost port=5432 dbname=VectorStore user=postgres password=??????");
+int main(int argc, char* argv[]) {
+	auto startTime = std::chrono::steady_clock::now();
+	std::string connString = "host=localhost port=5432 dbname=VectorStore user=postgres password=??????";
 	char userInput;										// user input for options
 
 	// options for parsing
 	std::string parsedJSONpath = "./Data/output";		// path to where JSON files are stored
-	size_t batchSize = 250;								// batch value for parsing to embedding server
-	size_t maxThreads = 8;	
+	size_t tokenBudget = 100'000;						// starting token budget per ingest batch, tuned while running
+	size_t memoryLimitMB = 4096;						// ingest batches shrink when resident heap memory goes above this
+	size_t maxConnections = 8;							// PostgreSQL connections, CPU use is bounded by cpuCores
 	int maxPages = 500;								// maximum number of pages to parse (-1 for no limit)
+	double ingestCpuShare = 0.5;						// share of embedder time background ingest may use while searching
+	std::string flatIndexPath = "./Data/vectors.edbf";	// exported embeddings for exact flat-scan search, loaded at startup if present
+	bool serverRerank = false;							// score candidates in Postgres, only the final results are sent back
+	size_t cpuCores = 0;								// core budget for inference and the shared thread pool, 0 for all cores
+	bool pinThreads = false;							// pin pool threads to the budgeted cores
 
-	VectorStorage storage(conn, maxThreads);		// Initialize vector storage
+	// command line options
+	int workerPort = 0;									// --embed-worker <port>, run as embedding worker only
+	std::vector<std::string> workerEndpoints;			// --embed-workers host:port,host:port, embed ingest on workers
+	std::string tracePath;								// --trace <file>, write Chrome trace-event JSON on exit
+	std::string corpusPath;								// --convert-corpus <file.edbc>, convert the JSON files and exit
+	bool compressCorpus = false;						// --compress, bzip2 compress the converted corpus blocks
+	bool migrate = false;								// --migrate, create or upgrade the database schema
 
-	ArticleParser parser(parsedJSONpath, batchSize, storage, maxPages);	// Initialize article parser, used for option 1
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--embed-worker" && i + 1 < argc) {
+			workerPort = std::stoi(argv[++i]);
+		}
+		else if (arg == "--embed-workers" && i + 1 < argc) {
+			std::stringstream list(argv[++i]);
+			std::string endpoint;
+			while (std::getline(list, endpoint, ',')) {
+				if (!endpoint.empty()) workerEndpoints.push_back(endpoint);
+			}
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			tracePath = argv[++i];
+		}
+		else if (arg == "--convert-corpus" && i + 1 < argc) {
+			corpusPath = argv[++i];
+		}
+		else if (arg == "--compress") {
+			compressCorpus = true;
+		}
+		else if (arg == "--cores" && i + 1 < argc) {
+			cpuCores = std::stoul(argv[++i]);
+		}
+		else if (arg == "--pin-threads") {
+			pinThreads = true;
+		}
+		else if (arg == "--migrate") {
+			migrate = true;
+		}
+	}
+
+	if (!tracePath.empty()) Trace::enable();
+	CpuBudget::configure(cpuCores, pinThreads);		// before any embedder or thread pool is created
+
+	// Embedding worker mode, no database needed
+	if (workerPort != 0) {
+		EmbeddingWorker worker("./models/model.onnx", "./models/vocab.txt", EMBED_MAX_TOKENS);
+
+		// listen() only returns after stop(), Ctrl+C stops the server so the trace still gets written
+		static std::atomic<bool> stopRequested{ false };
+		std::signal(SIGINT, [](int) { stopRequested = true; });
+		std::signal(SIGTERM, [](int) { stopRequested = true; });
+		std::atomic<bool> listening{ true };
+		std::thread stopWatcher([&] {
+			while (listening && !stopRequested) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (listening) worker.stop();
+		});
+
+		bool ok = worker.listen("0.0.0.0", workerPort);
+		listening = false;
+		stopWatcher.join();
+
+		if (!tracePath.empty()) Trace::writeChromeJson(tracePath);
+		return ok || stopRequested ? 0 : 1;
+	}
+
+	// Corpus conversion mode, no database or model needed
+	if (!corpusPath.empty()) {
+		try {
+			uint64_t articles = CorpusWriter::convertJsonDirectory(parsedJSONpath, corpusPath, compressCorpus);
+			std::cout << "Wrote " << articles << " articles to " << corpusPath << std::endl;
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error converting corpus: " << e.what() << std::endl;
+			return 1;
+		}
+		if (!tracePath.empty()) Trace::writeChromeJson(tracePath);
+		return 0;
+	}
+
+	ConnectionPool pool(connString, maxConnections);		// One connection per concurrent worker
+	// Schema DDL only runs with --migrate, normal starts do a single catalog lookup
+	try {
+		if (!migrate && !VectorStorage::schemaIsCurrent(pool)) {
+			std::cerr << "Database schema is missing or out of date, run once with --migrate" << std::endl;
+			return 1;
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Could not check database schema: " << e.what() << std::endl;
+		return 1;
+	}
+
+	VectorStorage storage(pool, migrate);				// Initialize vector storage
+	storage.setEmbeddingWorkers(workerEndpoints);
+	storage.setIngestCpuShare(ingestCpuShare);
+
+	try {
+		storage.loadFlatIndex(flatIndexPath);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Could not load flat index: " << e.what() << std::endl;
+	}
+
+	SearchConfig searchConfig = storage.getSearchConfig();
+	searchConfig.serverRerank = serverRerank;
+	storage.setSearchConfig(searchConfig);
+
+	ArticleParser parser(parsedJSONpath, tokenBudget, storage, maxPages, memoryLimitMB * 1024 * 1024);	// Initialize article parser, used for option 1
+	std::future<void> ingestTask;						// background ingestion started by option 1
+
+	std::cout << "Ready in " << std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - startTime).count() << " ms\n";
 
 	// Get user input for options (search, parse, exit)
 	while (true) {
 		std::cout << "Select an option:\n";
 		std::cout << "1. Parse JSON files and store vectors\n";
 		std::cout << "2. Search\n";
-		std::cout << "3. Exit\n";
-		std::cout << "Enter choice (1-3): ";
+		std::cout << "3. Suggest titles\n";
+		std::cout << "4. Benchmark search\n";
+		std::cout << "5. Search options (reduced dimensions, server-side rerank, flat index)\n";
+		std::cout << "6. Exit\n";
+		std::cout << "Enter choice (1-6): ";
 		std::cin >> userInput;
 
-		// Parse JSON files and store vectors
+		// Parse JSON files and store vectors in the background, search stays available
 		if (userInput == '1') {
-			try {
-				parser.parseJSONFiles();
-			}
-			catch (const std::exception& e) {
-				std::cerr << "Error during parsing and storing vectors: " << e.what() << std::endl;
+			if (ingestTask.valid() && ingestTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				std::cout << "Ingestion is already running.\n";
+				continue;
 			}
+
+			ingestTask = std::async(std::launch::async, [&parser] {
+				try {
+					parser.parseJSONFiles();
+				}
+				catch (const std::exception& e) {
+					std::cerr << "Error during parsing and storing vectors: " << e.what() << std::endl;
+				}
+			});
+			std::cout << "Ingestion started in the background.\n";
 		}
 
 		// Search interface
 		else if (userInput == '2') {
 			std::cin.ignore(); // clear leftover newline
 			std::string query;
+			std::string cursor;		// next page of the last query, empty when there are no more
+			SearchFilter filter;	// applies to following queries, set with 'filter ...'
+
+			// YYYY-MM-DD, optionally followed by a time, Postgres parses the rest
+			auto isIsoDate = [](const std::string& s) {
+				if (s.size() < 10 || s[4] != '-' || s[7] != '-') return false;
+				for (size_t i : { 0, 1, 2, 3, 5, 6, 8, 9 }) {
+					if (!std::isdigit(static_cast<unsigned char>(s[i]))) return false;
+				}
+				return s.size() == 10 || s[10] == 'T' || s[10] == ' ';
+			};
 
 			while (true) {
-				std::cout << "\nSearch query (or 'exit'): ";
+				std::cout << (cursor.empty() ? "\nSearch query, 'filter ...' or 'exit': " : "\nSearch query, 'more', 'filter ...' or 'exit': ");
 				std::getline(std::cin, query);
 
 				if (query == "exit" || query.empty())
 					break;
 
-				auto results = storage.search(query, 10);
+				// filter category=<name> after=<date> before=<date> ns=<n> minlength=<n>, or 'filter clear'
+				if (query == "filter" || query.rfind("filter ", 0) == 0) {
+					std::istringstream args(query.substr(6));
+					std::string arg;
+					SearchFilter next = filter;
+					bool valid = true;
+					while (args >> arg) {
+						if (arg == "clear") {
+							next = SearchFilter{};
+							continue;
+						}
+
+						size_t eq = arg.find('=');
+						std::string key = arg.substr(0, eq);
+						std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+						try {
+							if (key == "category") {
+								std::replace(value.begin(), value.end(), '_', ' ');	// spaces split arguments
+								std::transform(value.begin(), value.end(), value.begin(),
+									[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+								next.category = value;
+							}
+							else if ((key == "after" || key == "before") && (value.empty() || isIsoDate(value))) {
+								(key == "after" ? next.updatedAfter : next.updatedBefore) = value;
+							}
+							else if (key == "ns") {
+								if (value.empty()) next.ns.reset();
+								else next.ns = std::stoi(value);
+							}
+							else if (key == "minlength") {
+								next.minLength = value.empty() ? 0 : std::stoi(value);
+							}
+							else {
+								valid = false;
+							}
+						}
+						catch (const std::exception&) {
+							valid = false;
+						}
+
+						if (!valid) {
+							std::cout << "Invalid filter '" << arg << "', use category=, after=YYYY-MM-DD, before=YYYY-MM-DD, ns=, minlength= or clear.\n";
+							break;
+						}
+					}
+
+					if (valid) {
+						filter = next;
+						cursor.clear();
+						std::cout << (filter.empty() ? "No filter set.\n" : "Filter set.\n");
+					}
+					continue;
+				}
+
+				SearchPage page;
+				if (query == "more" && !cursor.empty()) {
+					page = storage.nextPage(cursor, 10);
+					if (page.expired) {
+						std::cout << "Search session expired, run the query again.\n";
+						cursor.clear();
+						continue;
+					}
+				}
+				else {
+					page = storage.searchPage(query, 10, storage.getSearchConfig(), filter);
+				}
+				cursor = page.cursor;
 
-				if (results.empty()) {
+				if (page.results.empty()) {
 					std::cout << "No results found.\n";
 					continue;
 				}
 
-				for (auto& r : results) {
+				for (auto& r : page.results) {
 					std::cout << "Title: " << r.title << "\n";
 					std::cout << "Link: " << r.link << "\n";
 					std::cout << "Score: " << r.score << "\n";
@@ -66,8 +285,133 @@ int main() {
 			}
 		}
 
-		// Exit program
+		// Title autocomplete interface
 		else if (userInput == '3') {
+			std::cin.ignore(); // clear leftover newline
+			std::string prefix;
+
+			while (true) {
+				std::cout << "\nTitle prefix (or 'exit'): ";
+				std::getline(std::cin, prefix);
+
+				if (prefix == "exit" || prefix.empty())
+					break;
+
+				auto matches = storage.suggestTitles(prefix, 10);
+
+				if (matches.empty()) {
+					std::cout << "No titles found.\n";
+					continue;
+				}
+
+				for (auto& m : matches) {
+					std::cout << m.title << "\n";
+				}
+			}
+		}
+
+		// Replay a query log and report latency, QPS and recall
+		else if (userInput == '4') {
+			BenchmarkOptions options;
+			char mode;
+
+			std::cout << "Mode, (c)losed loop, (o)pen loop or (r)erank microbenchmark: ";
+			std::cin >> mode;
+
+			if (mode == 'r') {
+				SearchBenchmark::printRerankReport(SearchBenchmark::runRerank(200, 1000));
+				continue;
+			}
+
+			std::cout << "Query log path: ";
+			std::cin >> options.queryLogPath;
+			std::cout << "Concurrency: ";
+			std::cin >> options.concurrency;
+			options.openLoop = (mode == 'o');
+			if (options.openLoop) {
+				std::cout << "Target QPS: ";
+				std::cin >> options.targetQps;
+			}
+			char paged;
+			std::cout << "Paged search like the interactive path (y/n): ";
+			std::cin >> paged;
+			options.paged = (paged == 'y');
+
+			try {
+				SearchBenchmark benchmark(storage, storage.getSearchConfig());
+				SearchBenchmark::printReport(benchmark.run(options), options);
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Error during benchmark: " << e.what() << std::endl;
+			}
+		}
+
+		// Build a PCA projection, export the flat index or toggle search modes
+		else if (userInput == '5') {
+			char action;
+			std::cout << "(b)uild projection, (t)oggle reduced search, toggle (s)erver-side rerank,\n"
+				<< "e(x)port flat index or toggle (f)lat index search: ";
+			std::cin >> action;
+
+			if (action == 'b') {
+				size_t outDim, sampleSize;
+				std::cout << "Reduced dimension (e.g. 128 or 192): ";
+				std::cin >> outDim;
+				std::cout << "Sample size: ";
+				std::cin >> sampleSize;
+
+				try {
+					ProjectionReport report = storage.buildProjection(outDim, sampleSize, 100);
+					std::cout << "Projected " << report.rowsProjected << " rows to " << report.outDim
+						<< " dims from " << report.samples << " samples\n";
+					std::cout << "Explained variance: " << report.explainedVariance << "\n";
+					std::cout << "Recall@" << report.k << " vs " << DIM << " dims: " << report.recallAtK << "\n";
+				}
+				catch (const std::exception& e) {
+					std::cerr << "Error building projection: " << e.what() << std::endl;
+				}
+			}
+			else if (action == 't') {
+				SearchConfig config = storage.getSearchConfig();
+				config.useReduced = !config.useReduced && storage.hasProjection();
+				storage.setSearchConfig(config);
+				std::cout << "Reduced search " << (config.useReduced ? "enabled" : "disabled") << "\n";
+			}
+			else if (action == 's') {
+				SearchConfig config = storage.getSearchConfig();
+				config.serverRerank = !config.serverRerank;
+				storage.setSearchConfig(config);
+				std::cout << "Server-side rerank " << (config.serverRerank ? "enabled" : "disabled") << "\n";
+			}
+			else if (action == 'x') {
+				char precision;
+				std::cout << "Precision, (s)ingle fp32 or (h)alf fp16: ";
+				std::cin >> precision;
+
+				try {
+					size_t rows = storage.exportFlatIndex(flatIndexPath,
+						precision == 'h' ? FlatElement::Float16 : FlatElement::Float32);
+					std::cout << "Exported " << rows << " embeddings to " << flatIndexPath
+						<< ", scan kernel: " << FlatIndex::kernelName() << "\n";
+				}
+				catch (const std::exception& e) {
+					std::cerr << "Error exporting flat index: " << e.what() << std::endl;
+				}
+			}
+			else if (action == 'f') {
+				SearchConfig config = storage.getSearchConfig();
+				config.useFlatIndex = !config.useFlatIndex && storage.hasFlatIndex();
+				storage.setSearchConfig(config);
+				std::cout << "Flat index search " << (config.useFlatIndex ? "enabled" : "disabled") << "\n";
+			}
+		}
+
+		// Exit program, a running ingestion stops after its current batch
+		else if (userInput == '6') {
+			if (ingestTask.valid()) {
+				parser.requestStop();
+				ingestTask.wait();
+			}
 			break;
 		}
 
@@ -75,5 +419,13 @@ int main() {
 			std::cout << "Invalid choice. Please try again.\n";
 		}
 	}
+
+	// Write trace once ingestion and searches have finished
+	if (!tracePath.empty()) {
+		if (Trace::writeChromeJson(tracePath))
+			std::cout << "Trace written to " << tracePath << "\n";
+		else
+			std::cerr << "Could not write trace to " << tracePath << "\n";
+	}
 	return 0;
 }